@@ -0,0 +1,132 @@
+/*
+ * argbench.c
+ *
+ * User-level benchmark for exec with many arguments. Not part of the
+ * kernel: build it as a testbin program.
+ *
+ * Usage: argbench [iterations [self]]
+ *
+ * Repeatedly forks and execs itself (SELF, default /testbin/argbench)
+ * with argument lists of increasing size, and prints the mean time
+ * per fork+exec+exit for each size. The child checks that it got the
+ * arguments it was sent and exits 0 if so. Each argument is ARGLEN
+ * characters long, so the largest lists spill past one page.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#define DEFAULT_ITERS	20
+#define DEFAULT_SELF	"/testbin/argbench"
+#define CHILDFLAG	"-child"
+#define ARGLEN		15	/* matches the %015d below */
+#define MAXARGS		1024
+
+static char argstore[MAXARGS][ARGLEN + 1];
+static char *args[MAXARGS + 3];
+
+/*
+ * In the child: argv[1] is CHILDFLAG and argv[2] onward should be
+ * the numbered arguments made by makeargs.
+ */
+static
+int
+child(int argc, char *argv[])
+{
+	char expect[ARGLEN + 1];
+	int i;
+
+	for (i=2; i<argc; i++) {
+		snprintf(expect, sizeof(expect), "%015d", i - 2);
+		if (strcmp(argv[i], expect) != 0) {
+			return 1;
+		}
+	}
+	return argv[argc] == NULL ? 0 : 1;
+}
+
+static
+void
+makeargs(const char *self, int nargs)
+{
+	int i;
+
+	args[0] = (char *)self;
+	args[1] = (char *)CHILDFLAG;
+	for (i=0; i<nargs; i++) {
+		snprintf(argstore[i], sizeof(argstore[i]), "%015d", i);
+		args[i + 2] = argstore[i];
+	}
+	args[nargs + 2] = NULL;
+}
+
+static
+void
+run(const char *self, int nargs, int iters)
+{
+	unsigned long long ns;
+	time_t s1, s2;
+	unsigned long ns1, ns2;
+	pid_t pid;
+	int i, status;
+
+	makeargs(self, nargs);
+
+	__time(&s1, &ns1);
+	for (i=0; i<iters; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			execv(args[0], args);
+			_exit(255);
+		}
+		if (waitpid(pid, &status, 0) != pid) {
+			err(1, "waitpid %d", pid);
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "exec with %d args failed, status %d",
+			     nargs, status);
+		}
+	}
+	__time(&s2, &ns2);
+
+	ns = (unsigned long long)(s2 - s1) * 1000000000ULL + ns2 - ns1;
+	printf("argbench nargs=%d iters=%d time_ns=%llu ns_per_exec=%llu\n",
+	       nargs, iters, ns, ns / iters);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const int sizes[] = { 0, 4, 64, 256, MAXARGS };
+	const char *self = DEFAULT_SELF;
+	int iters = DEFAULT_ITERS;
+	unsigned i;
+
+	if (argc > 1 && !strcmp(argv[1], CHILDFLAG)) {
+		return child(argc, argv);
+	}
+
+	if (argc > 1) {
+		iters = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		self = argv[2];
+	}
+	if (argc > 3 || iters <= 0) {
+		errx(1, "Usage: argbench [iterations [self]]");
+	}
+
+	for (i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+		run(self, sizes[i], iters);
+	}
+	return 0;
+}
@@ -0,0 +1,255 @@
+/*
+ * Argument packing for new programs. See argpack.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <copyinout.h>
+#include <vm.h>
+#include <argpack.h>
+
+#define ARGPACK_SMALL	PAGE_SIZE
+#define ARGPACK_POOLMAX	4
+
+static struct spinlock argpack_lock = SPINLOCK_INITIALIZER;
+static char *argpack_pool[ARGPACK_POOLMAX];
+static unsigned argpack_npool;
+
+static
+int
+argpack_init(struct argpack *ap)
+{
+	char *buf = NULL;
+
+	spinlock_acquire(&argpack_lock);
+	if (argpack_npool > 0) {
+		buf = argpack_pool[--argpack_npool];
+	}
+	spinlock_release(&argpack_lock);
+
+	if (buf == NULL) {
+		buf = kmalloc(ARGPACK_SMALL);
+		if (buf == NULL) {
+			return ENOMEM;
+		}
+	}
+	ap->ap_buf = buf;
+	ap->ap_bufsize = ARGPACK_SMALL;
+	ap->ap_argc = 0;
+	ap->ap_size = 0;
+	return 0;
+}
+
+void
+argpack_cleanup(struct argpack *ap)
+{
+	if (ap->ap_bufsize == ARGPACK_SMALL) {
+		spinlock_acquire(&argpack_lock);
+		if (argpack_npool < ARGPACK_POOLMAX) {
+			argpack_pool[argpack_npool++] = ap->ap_buf;
+			ap->ap_buf = NULL;
+		}
+		spinlock_release(&argpack_lock);
+	}
+	/* kfree ignores NULL */
+	kfree(ap->ap_buf);
+	ap->ap_buf = NULL;
+}
+
+/*
+ * Make sure there is room for SIZE bytes, moving to a buffer of
+ * ARG_MAX if need be and keeping the first USED bytes.
+ */
+static
+int
+argpack_reserve(struct argpack *ap, size_t size, size_t used)
+{
+	char *big;
+
+	if (size <= ap->ap_bufsize) {
+		return 0;
+	}
+	if (size > ARG_MAX || ap->ap_bufsize == ARG_MAX) {
+		return E2BIG;
+	}
+	big = kmalloc(ARG_MAX);
+	if (big == NULL) {
+		return ENOMEM;
+	}
+	memcpy(big, ap->ap_buf, used);
+	argpack_cleanup(ap);
+	ap->ap_buf = big;
+	ap->ap_bufsize = ARG_MAX;
+	return 0;
+}
+
+static
+vaddr_t *
+argpack_slots(struct argpack *ap)
+{
+	return (vaddr_t *)ap->ap_buf;
+}
+
+/*
+ * Finish off a string of LEN bytes (including the terminator) just
+ * placed at *OFF: record it in slot I and pad it out to 4 bytes.
+ */
+static
+int
+argpack_endstr(struct argpack *ap, int i, size_t *off, size_t len)
+{
+	size_t padded;
+	int result;
+
+	padded = len;
+	if (padded % 4) padded += 4 - padded % 4;
+	result = argpack_reserve(ap, *off + padded, *off + len);
+	if (result) {
+		return result;
+	}
+	while (len < padded) {
+		ap->ap_buf[*off + len++] = '\0';
+	}
+
+	argpack_slots(ap)[i] = *off;
+	*off += padded;
+	return 0;
+}
+
+int
+argpack_copyin(struct argpack *ap, userptr_t uargv)
+{
+	userptr_t uarg;
+	size_t off, len;
+	int argc, i;
+	int result;
+
+	COMPILE_ASSERT(sizeof(vaddr_t) == sizeof(userptr_t));
+
+	result = argpack_init(ap);
+	if (result) {
+		return result;
+	}
+
+	/* copy in the pointers, up to and including the NULL */
+	for (argc = 0; ; argc++) {
+		off = argc * sizeof(vaddr_t);
+		result = argpack_reserve(ap, off + sizeof(vaddr_t), off);
+		if (result) {
+			goto fail;
+		}
+		result = copyin((const_userptr_t)((vaddr_t)uargv + off),
+				ap->ap_buf + off, sizeof(vaddr_t));
+		if (result) {
+			goto fail;
+		}
+		if (argpack_slots(ap)[argc] == 0) {
+			break;
+		}
+	}
+
+	/* then the strings, right after the pointers */
+	off = (argc + 1) * sizeof(vaddr_t);
+	for (i = 0; i < argc; i++) {
+		uarg = (userptr_t)argpack_slots(ap)[i];
+		result = copyinstr((const_userptr_t)uarg, ap->ap_buf + off,
+				   ap->ap_bufsize - off, &len);
+		if (result == ENAMETOOLONG && ap->ap_bufsize < ARG_MAX) {
+			/* ran out of page; retry in a big buffer */
+			result = argpack_reserve(ap, ARG_MAX, off);
+			if (result) {
+				goto fail;
+			}
+			result = copyinstr((const_userptr_t)uarg,
+					   ap->ap_buf + off,
+					   ap->ap_bufsize - off, &len);
+		}
+		if (result) {
+			if (result == ENAMETOOLONG) {
+				result = E2BIG;
+			}
+			goto fail;
+		}
+		result = argpack_endstr(ap, i, &off, len);
+		if (result) {
+			goto fail;
+		}
+	}
+
+	ap->ap_argc = argc;
+	ap->ap_size = off;
+	return 0;
+
+ fail:
+	argpack_cleanup(ap);
+	return result;
+}
+
+int
+argpack_kinit(struct argpack *ap, int argc, char **args)
+{
+	size_t off, len;
+	int i, result;
+
+	result = argpack_init(ap);
+	if (result) {
+		return result;
+	}
+
+	off = (argc + 1) * sizeof(vaddr_t);
+	result = argpack_reserve(ap, off, 0);
+	if (result) {
+		goto fail;
+	}
+
+	for (i = 0; i < argc; i++) {
+		len = strlen(args[i]) + 1;
+		result = argpack_reserve(ap, off + len, off);
+		if (result) {
+			goto fail;
+		}
+		memcpy(ap->ap_buf + off, args[i], len);
+		result = argpack_endstr(ap, i, &off, len);
+		if (result) {
+			goto fail;
+		}
+	}
+
+	ap->ap_argc = argc;
+	ap->ap_size = off;
+	return 0;
+
+ fail:
+	argpack_cleanup(ap);
+	return result;
+}
+
+int
+argpack_copyout(struct argpack *ap, vaddr_t *stackptr, userptr_t *uargv)
+{
+	vaddr_t *slots = argpack_slots(ap);
+	vaddr_t sp;
+	int i, result;
+
+	/* the stack pointer must be 8-aligned; so then is argv */
+	sp = *stackptr - ap->ap_size;
+	sp -= sp % 8;
+
+	/* turn offsets into user addresses */
+	for (i = 0; i < ap->ap_argc; i++) {
+		slots[i] += sp;
+	}
+	slots[ap->ap_argc] = 0;
+
+	result = copyout(ap->ap_buf, (userptr_t)sp, ap->ap_size);
+	if (result) {
+		return result;
+	}
+
+	*uargv = (userptr_t)sp;
+	*stackptr = sp;
+	return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef _ARGPACK_H_
+#define _ARGPACK_H_
+
+/*
+ * Argument packing for new programs.
+ *
+ * An argpack holds a program's arguments in the kernel, laid out
+ * exactly as they will appear on the new user stack: first the argv
+ * array (argc+1 pointers), then the strings, each padded to 4 bytes.
+ * While in the kernel the argv slots hold each string's offset in the
+ * buffer; argpack_copyout rebases them to user addresses and moves
+ * the whole image with a single copyout, leaving the stack pointer
+ * 8-aligned with argv right at it.
+ *
+ * Nearly every argument list fits in a page, so page-sized buffers are
+ * kept in a small pool and reused; a list that outgrows its page is
+ * moved to a buffer of ARG_MAX.
+ *
+ * runprogram, execv and spawn all start programs through this.
+ *
+ * Functions:
+ *     argpack_copyin  - fill AP from the NULL-terminated user argv
+ *                       UARGV.
+ *     argpack_kinit   - fill AP from the kernel strings ARGS[0..ARGC).
+ *     argpack_copyout - put AP on the current address space's stack
+ *                       below *STACKPTR; returns the new stack pointer
+ *                       in *STACKPTR and the user argv in *UARGV.
+ *     argpack_cleanup - release AP's buffer.
+ */
+
+struct argpack {
+	char *ap_buf;
+	size_t ap_bufsize;	/* ARGPACK_SMALL or ARG_MAX */
+	int ap_argc;
+	size_t ap_size;		/* bytes in use */
+};
+
+int argpack_copyin(struct argpack *ap, userptr_t uargv);
+int argpack_kinit(struct argpack *ap, int argc, char **args);
+int argpack_copyout(struct argpack *ap, vaddr_t *stackptr, userptr_t *uargv);
+void argpack_cleanup(struct argpack *ap);
+
+#endif /* _ARGPACK_H_ */
@@ -0,0 +1,120 @@
+/*
+ * Deferred address space teardown. See asreaper.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <addrspace.h>
+#include <tlbbatch.h>
+#include <asreaper.h>
+
+static struct {
+	struct lock *ar_lock;		/* protects everything below */
+	struct cv *ar_work;		/* signalled when work is queued */
+	struct cv *ar_idle;		/* signalled when a batch is done */
+	struct addrspace *ar_queue[ASREAPER_QMAX];
+	unsigned ar_count;		/* entries in ar_queue */
+	bool ar_busy;			/* reaper is mid-batch */
+	bool ar_running;		/* reaper thread has started */
+} asreaper;
+
+/*
+ * The reaper thread. Empties the queue into a local batch and
+ * destroys the batch with the queue unlocked, so exits can keep
+ * queueing meanwhile.
+ */
+static
+void
+asreaper_thread(void *junk, unsigned long junk2)
+{
+	struct addrspace *batch[ASREAPER_QMAX];
+	unsigned i, n;
+
+	(void)junk;
+	(void)junk2;
+
+	lock_acquire(asreaper.ar_lock);
+	while (1) {
+		while (asreaper.ar_count == 0) {
+			asreaper.ar_busy = false;
+			cv_broadcast(asreaper.ar_idle, asreaper.ar_lock);
+			cv_wait(asreaper.ar_work, asreaper.ar_lock);
+		}
+		asreaper.ar_busy = true;
+
+		n = asreaper.ar_count;
+		for (i=0; i<n; i++) {
+			batch[i] = asreaper.ar_queue[i];
+		}
+		asreaper.ar_count = 0;
+		lock_release(asreaper.ar_lock);
+
+		for (i=0; i<n; i++) {
+			as_destroy(batch[i]);
+		}
+
+		lock_acquire(asreaper.ar_lock);
+	}
+}
+
+void
+asreaper_bootstrap(void)
+{
+	int result;
+
+	asreaper.ar_lock = lock_create("asreaper");
+	asreaper.ar_work = cv_create("asreaper work");
+	asreaper.ar_idle = cv_create("asreaper idle");
+	if (asreaper.ar_lock == NULL || asreaper.ar_work == NULL ||
+	    asreaper.ar_idle == NULL) {
+		panic("asreaper_bootstrap: out of memory\n");
+	}
+	asreaper.ar_count = 0;
+	asreaper.ar_busy = false;
+
+	result = thread_fork("asreaper", NULL, asreaper_thread, NULL, 0);
+	if (result) {
+		panic("asreaper_bootstrap: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	asreaper.ar_running = true;
+}
+
+void
+asreaper_defer(struct addrspace *as)
+{
+	if (as == NULL) {
+		return;
+	}
+	tlbbatch_forget(as);
+
+	if (asreaper.ar_running) {
+		lock_acquire(asreaper.ar_lock);
+		if (asreaper.ar_count < ASREAPER_QMAX) {
+			asreaper.ar_queue[asreaper.ar_count++] = as;
+			cv_signal(asreaper.ar_work, asreaper.ar_lock);
+			lock_release(asreaper.ar_lock);
+			return;
+		}
+		lock_release(asreaper.ar_lock);
+	}
+
+	/* too far behind (or too early); do it ourselves */
+	as_destroy(as);
+}
+
+void
+asreaper_flush(void)
+{
+	if (!asreaper.ar_running) {
+		return;
+	}
+
+	lock_acquire(asreaper.ar_lock);
+	while (asreaper.ar_count > 0 || asreaper.ar_busy) {
+		cv_wait(asreaper.ar_idle, asreaper.ar_lock);
+	}
+	lock_release(asreaper.ar_lock);
+}
@@ -0,0 +1,37 @@
+#ifndef _ASREAPER_H_
+#define _ASREAPER_H_
+
+/*
+ * Deferred address space teardown.
+ *
+ * Destroying an address space frees every page in it, which for a
+ * large process takes a while. Nobody needs to wait for that: once a
+ * process has published its exit status and given up its address
+ * space, the space is unreachable. So exit and execv hand the old
+ * space to a reaper thread instead of destroying it themselves, and
+ * the exiting process (and the parent waiting for it) can carry on at
+ * once.
+ *
+ * The reaper takes everything queued each time it wakes up and
+ * destroys it all in one go, so a burst of exits is cleaned up in a
+ * single batch. If the queue is full, the caller destroys the space
+ * itself, which bounds how much memory can be waiting to be freed.
+ *
+ * Functions:
+ *     asreaper_bootstrap - start the reaper thread.
+ *     asreaper_defer     - queue AS for destruction. AS must already
+ *                          be deactivated and detached from its
+ *                          process.
+ *     asreaper_flush     - wait until everything queued so far has
+ *                          been destroyed.
+ */
+
+#define ASREAPER_QMAX	64	/* address spaces waiting at most */
+
+struct addrspace;
+
+void asreaper_bootstrap(void);
+void asreaper_defer(struct addrspace *as);
+void asreaper_flush(void);
+
+#endif /* _ASREAPER_H_ */
@@ -0,0 +1,26 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+/*
+ * Declarations for kernel benchmarks. These are invoked from the
+ * menu like the tests in test.h; each one prints its results and
+ * returns 0, or an error code if the arguments are bad or it could
+ * not get the memory or threads it needs.
+ */
+
+/* counterbench.c */
+int counterbench(int nargs, char **args);
+
+/* switchbench.c */
+int switchbench(int nargs, char **args);
+
+/* microbench.c */
+int yieldbench(int nargs, char **args);
+int sembench(int nargs, char **args);
+int lockbench(int nargs, char **args);
+int forkexitbench(int nargs, char **args);
+int mallocbench(int nargs, char **args);
+int clocksleepbench(int nargs, char **args);
+int microbench(int nargs, char **args);
+
+#endif /* _BENCH_H_ */
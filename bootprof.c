@@ -0,0 +1,198 @@
+/*
+ * Boot-time profiling. See bootprof.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spinlock.h>
+#include <bootprof.h>
+
+struct bootphase {
+	const char *bp_name;
+	bool bp_timed;			/* false if before the clock */
+	bool bp_open;			/* still running */
+	uint64_t bp_start;		/* ns since bootprof_clockready */
+	uint64_t bp_end;
+};
+
+static struct spinlock bootprof_lock = SPINLOCK_INITIALIZER;
+static struct bootphase bootphases[BOOTPROF_MAX];
+static unsigned bootprof_num;
+static struct bootphase *bootprof_cur;	/* phase boot() is in */
+static bool bootprof_haveclock;
+static uint64_t bootprof_base;		/* monotonic ns at clockready */
+static uint64_t bootprof_end;		/* monotonic ns at done */
+
+static
+uint64_t
+bootprof_now(void)
+{
+	return bootprof_haveclock ? clock_monotonic_ns() : 0;
+}
+
+/*
+ * Get a free record, or NULL if they have run out. Called with
+ * bootprof_lock held.
+ */
+static
+struct bootphase *
+bootprof_alloc(const char *name)
+{
+	struct bootphase *bp;
+
+	if (bootprof_num == BOOTPROF_MAX) {
+		return NULL;
+	}
+	bp = &bootphases[bootprof_num++];
+	bp->bp_name = name;
+	bp->bp_timed = bootprof_haveclock;
+	bp->bp_open = false;
+	bp->bp_start = bp->bp_end = 0;
+	return bp;
+}
+
+/*
+ * Close the current phase. Called with bootprof_lock held.
+ */
+static
+void
+bootprof_close(uint64_t now)
+{
+	if (bootprof_cur != NULL) {
+		bootprof_cur->bp_end = now;
+		bootprof_cur->bp_open = false;
+		bootprof_cur = NULL;
+	}
+}
+
+void
+bootprof_phase(const char *name)
+{
+	uint64_t now;
+
+	now = bootprof_now();
+
+	spinlock_acquire(&bootprof_lock);
+	bootprof_close(now);
+	bootprof_cur = bootprof_alloc(name);
+	if (bootprof_cur != NULL) {
+		bootprof_cur->bp_start = now;
+		bootprof_cur->bp_open = true;
+	}
+	spinlock_release(&bootprof_lock);
+}
+
+void
+bootprof_done(void)
+{
+	uint64_t now;
+
+	now = bootprof_now();
+
+	spinlock_acquire(&bootprof_lock);
+	bootprof_close(now);
+	bootprof_end = now;
+	spinlock_release(&bootprof_lock);
+}
+
+/*
+ * Start the clock. The phase under way started before we could read
+ * the time, so it stays untimed.
+ */
+void
+bootprof_clockready(void)
+{
+	uint64_t now;
+
+	now = clock_monotonic_ns();
+
+	spinlock_acquire(&bootprof_lock);
+	bootprof_haveclock = true;
+	bootprof_base = now;
+	spinlock_release(&bootprof_lock);
+}
+
+void
+bootprof_record(const char *name, uint64_t start, uint64_t end)
+{
+	struct bootphase *bp;
+
+	spinlock_acquire(&bootprof_lock);
+	bp = bootprof_alloc(name);
+	if (bp != NULL) {
+		bp->bp_timed = true;
+		bp->bp_start = start;
+		bp->bp_end = end;
+	}
+	spinlock_release(&bootprof_lock);
+}
+
+/*
+ * True if A should be listed before B: timed phases longest first,
+ * then everything else.
+ */
+static
+bool
+bootprof_before(const struct bootphase *a, const struct bootphase *b)
+{
+	if (!a->bp_timed || a->bp_open) {
+		return false;
+	}
+	if (!b->bp_timed || b->bp_open) {
+		return true;
+	}
+	return a->bp_end - a->bp_start > b->bp_end - b->bp_start;
+}
+
+/*
+ * Print the breakdown. Insertion sort on a copy: there are only a
+ * few dozen records, and this way the table itself stays in boot
+ * order, and phases that can't be compared stay in boot order too.
+ */
+void
+bootprof_print(void)
+{
+	struct bootphase phases[BOOTPROF_MAX];
+	struct bootphase tmp;
+	unsigned i, j, n;
+
+	spinlock_acquire(&bootprof_lock);
+	n = bootprof_num;
+	for (i=0; i<n; i++) {
+		phases[i] = bootphases[i];
+	}
+	spinlock_release(&bootprof_lock);
+
+	for (i=1; i<n; i++) {
+		tmp = phases[i];
+		for (j=i; j>0 && bootprof_before(&tmp, &phases[j-1]); j--) {
+			phases[j] = phases[j-1];
+		}
+		phases[j] = tmp;
+	}
+
+	kprintf("boot profile (us, slowest first):\n");
+	for (i=0; i<n; i++) {
+		if (!phases[i].bp_timed) {
+			kprintf("  %-20s  (before the clock)\n",
+				phases[i].bp_name);
+		}
+		else if (phases[i].bp_open) {
+			kprintf("  %-20s  (still running)\n",
+				phases[i].bp_name);
+		}
+		else {
+			kprintf("  %-20s %8llu  at %8llu\n", phases[i].bp_name,
+				(unsigned long long)
+				((phases[i].bp_end - phases[i].bp_start) / 1000),
+				(unsigned long long)
+				((phases[i].bp_start - bootprof_base) / 1000));
+		}
+	}
+	if (bootprof_end > bootprof_base) {
+		kprintf("  %-20s %8llu\n", "total (timed)",
+			(unsigned long long)
+			((bootprof_end - bootprof_base) / 1000));
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef _BOOTPROF_H_
+#define _BOOTPROF_H_
+
+/*
+ * Boot-time profiling.
+ *
+ * boot() brackets each of its phases with bootprof_phase, and boot
+ * tasks (see boottask.h) record themselves as they finish. Records
+ * go in a small static array, so this needs no memory allocation,
+ * works from the first line of boot(), and costs one clock read per
+ * phase, which is cheap enough to leave on all the time.
+ *
+ * There is no clock to read until mainbus_bootstrap has attached
+ * the clock device, and nothing machine-independent to count with
+ * before that. So phases that start before then (mainbus_bootstrap
+ * itself included) are listed in order but without times.
+ * bootprof_clockready marks the point where timing starts, and times
+ * are given relative to it.
+ *
+ * bootprof_print lists the phases slowest first, followed by the
+ * total from the clock coming up to the end of boot. It is called
+ * once after boot and backs the "bp" menu command.
+ *
+ * Functions:
+ *     bootprof_phase      - end the current phase and start NAME.
+ *     bootprof_done       - end the current phase; boot is over.
+ *     bootprof_clockready - the clock can now be read.
+ *     bootprof_record     - record a phase timed elsewhere (START and
+ *                           END in monotonic ns), such as a boot task
+ *                           on another CPU.
+ *     bootprof_print      - print the breakdown.
+ */
+
+#define BOOTPROF_MAX	32
+
+void bootprof_phase(const char *name);
+void bootprof_done(void);
+void bootprof_clockready(void);
+void bootprof_record(const char *name, uint64_t start, uint64_t end);
+void bootprof_print(void);
+
+#endif /* _BOOTPROF_H_ */
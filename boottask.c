@@ -0,0 +1,161 @@
+/*
+ * Parallel boot tasks. See boottask.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <clock.h>
+#include <synch.h>
+#include <current.h>
+#include <bootprof.h>
+#include <boottask.h>
+
+struct boottask {
+	const char *bt_name;
+	void (*bt_func)(void);
+	uint32_t bt_after;		/* prerequisites */
+	bool bt_started;
+	unsigned bt_cpu;		/* where it ran */
+	uint64_t bt_start;		/* monotonic ns */
+	uint64_t bt_end;
+};
+
+static struct {
+	struct lock *bq_lock;		/* protects everything below */
+	struct cv *bq_cv;		/* signalled when a task finishes */
+	struct boottask bq_tasks[BOOTTASK_MAX];
+	unsigned bq_num;		/* tasks added */
+	unsigned bq_ndone;		/* tasks finished */
+	uint32_t bq_done;		/* mask of finished tasks */
+} bootq;
+
+void
+boottask_bootstrap(void)
+{
+	bootq.bq_lock = lock_create("boottask");
+	bootq.bq_cv = cv_create("boottask");
+	if (bootq.bq_lock == NULL || bootq.bq_cv == NULL) {
+		panic("boottask_bootstrap: out of memory\n");
+	}
+	bootq.bq_num = 0;
+	bootq.bq_ndone = 0;
+	bootq.bq_done = 0;
+}
+
+unsigned
+boottask_add(const char *name, void (*func)(void), uint32_t after)
+{
+	struct boottask *bt;
+	unsigned id;
+
+	KASSERT(bootq.bq_lock != NULL);
+	KASSERT(bootq.bq_num < BOOTTASK_MAX);
+
+	id = bootq.bq_num++;
+	/* prerequisites must already exist, so there can be no cycles */
+	KASSERT((after & ~(BOOTTASK_AFTER(id) - 1)) == 0);
+
+	bt = &bootq.bq_tasks[id];
+	bt->bt_name = name;
+	bt->bt_func = func;
+	bt->bt_after = after;
+	bt->bt_started = false;
+	bt->bt_cpu = 0;
+	bt->bt_start = bt->bt_end = 0;
+	return id;
+}
+
+/*
+ * Take the first task that is ready to go, or return NULL. Called
+ * with bq_lock held.
+ */
+static
+struct boottask *
+boottask_next(void)
+{
+	struct boottask *bt;
+	unsigned i;
+
+	for (i=0; i<bootq.bq_num; i++) {
+		bt = &bootq.bq_tasks[i];
+		if (!bt->bt_started && (bt->bt_after & ~bootq.bq_done) == 0) {
+			bt->bt_started = true;
+			return bt;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Run tasks until all of them are done.
+ */
+static
+void
+boottask_work(void)
+{
+	struct boottask *bt;
+
+	lock_acquire(bootq.bq_lock);
+	while (bootq.bq_ndone < bootq.bq_num) {
+		bt = boottask_next();
+		if (bt == NULL) {
+			/* all remaining tasks are running or waiting */
+			cv_wait(bootq.bq_cv, bootq.bq_lock);
+			continue;
+		}
+		lock_release(bootq.bq_lock);
+
+		bt->bt_start = clock_monotonic_ns();
+		bt->bt_func();
+		bt->bt_end = clock_monotonic_ns();
+		/* may have migrated while running; note where it ended */
+		bt->bt_cpu = curcpu->c_number;
+		bootprof_record(bt->bt_name, bt->bt_start, bt->bt_end);
+
+		lock_acquire(bootq.bq_lock);
+		bootq.bq_done |= BOOTTASK_AFTER(bt - bootq.bq_tasks);
+		bootq.bq_ndone++;
+		cv_broadcast(bootq.bq_cv, bootq.bq_lock);
+	}
+	lock_release(bootq.bq_lock);
+}
+
+void
+boottask_run(void)
+{
+	boottask_work();
+}
+
+void
+boottask_help(void)
+{
+	if (bootq.bq_lock == NULL) {
+		/* nothing was set up */
+		return;
+	}
+	boottask_work();
+}
+
+void
+boottask_print(void)
+{
+	struct boottask *bt;
+	uint64_t end;
+	unsigned i;
+
+	end = 0;
+	kprintf("boot timeline (us):\n");
+	for (i=0; i<bootq.bq_num; i++) {
+		bt = &bootq.bq_tasks[i];
+		kprintf("  %-14s cpu%u %8llu - %8llu\n", bt->bt_name,
+			bt->bt_cpu,
+			(unsigned long long)(bt->bt_start / 1000),
+			(unsigned long long)(bt->bt_end / 1000));
+		if (bt->bt_end > end) {
+			end = bt->bt_end;
+		}
+	}
+	kprintf("  all tasks done at %llu us\n",
+		(unsigned long long)(end / 1000));
+}
@@ -0,0 +1,45 @@
+#ifndef _BOOTTASK_H_
+#define _BOOTTASK_H_
+
+/*
+ * Parallel boot tasks.
+ *
+ * The later parts of boot() are mostly independent of each other,
+ * but used to run one after the other on cpu0 while the secondary
+ * CPUs had nothing to do. Instead boot() now registers them as tasks,
+ * each with the set of tasks it has to run after, starts the other
+ * CPUs, and all the CPUs work through the graph together: each one
+ * repeatedly takes a task whose prerequisites are finished and runs
+ * it. boottask_run returns on cpu0 once every task is done; the
+ * secondaries return from boottask_help at the same point and go
+ * on to normal scheduling.
+ *
+ * Each task's CPU and start and finish times are recorded, and
+ * boottask_print shows them as a timeline, in microseconds since
+ * the monotonic clock started.
+ *
+ * Tasks run in thread context with interrupts on and may sleep.
+ * They must not depend on running on any particular CPU.
+ *
+ * Functions:
+ *     boottask_bootstrap - set up; call before adding tasks.
+ *     boottask_add       - add task NAME running FUNC after the tasks
+ *                          in AFTER (a mask of BOOTTASK_AFTER(id)
+ *                          bits, or 0). Returns the new task's id.
+ *                          All tasks must be added before
+ *                          thread_start_cpus.
+ *     boottask_run       - run the graph to completion (cpu0).
+ *     boottask_help      - help run it (secondary CPUs, at hatch).
+ *     boottask_print     - print the timeline.
+ */
+
+#define BOOTTASK_MAX		16
+#define BOOTTASK_AFTER(id)	((uint32_t)1 << (id))
+
+void boottask_bootstrap(void);
+unsigned boottask_add(const char *name, void (*func)(void), uint32_t after);
+void boottask_run(void);
+void boottask_help(void);
+void boottask_print(void);
+
+#endif /* _BOOTTASK_H_ */
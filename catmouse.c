@@ -33,6 +33,7 @@
 #include <thread.h>
 #include <synch.h>
 #include <synchprobs.h>
+#include <histogram.h>
 
 /* functions defined and used internally */
 static void initialize_bowls(void);
@@ -111,16 +112,14 @@ static volatile int eating_mice_count;
  */
 static struct semaphore *mutex;
 
-/* performance statistics */
-static volatile time_t cat_total_wait_secs;
-static volatile uint32_t cat_total_wait_nsecs;
-static volatile int cat_wait_count;
-static volatile time_t mouse_total_wait_secs;
-static volatile uint32_t mouse_total_wait_nsecs;
-static volatile int mouse_wait_count;
-
-/* mutex to provide mutual exclusion to performance stats */
-static struct semaphore *perf_mutex;
+/* performance statistics
+ * Every wait is recorded in a per-CPU histogram, so every cat and mouse
+ * can update them without serializing on a shared mutex, and the tail
+ * of the waits can be reported as well as the mean. They are read
+ * once, after all of the simulation threads have finished.
+ */
+static struct histogram *cat_wait_hist;
+static struct histogram *mouse_wait_hist;
 
 
 /*
@@ -158,18 +157,12 @@ initialize_bowls()
   if (mutex == NULL) {
     panic("initialize_bowls: could not create mutex\n");
   }
-  /* intialize perf_mutex semaphore */
-  perf_mutex = sem_create("stats mutex",1);
-  if (perf_mutex == NULL) {
-    panic("initialize_bowls: could not create perf_mutex\n");
+  /* intialize performance statistics histograms */
+  cat_wait_hist = hist_create("cat_wait");
+  mouse_wait_hist = hist_create("mouse_wait");
+  if (cat_wait_hist == NULL || mouse_wait_hist == NULL) {
+    panic("initialize_bowls: could not create statistics histograms\n");
   }
-
-  cat_total_wait_secs = 0;
-  cat_total_wait_nsecs = 0;
-  cat_wait_count = 0;
-  mouse_total_wait_secs = 0;
-  mouse_total_wait_nsecs = 0;
-  mouse_wait_count = 0;
   
   return;
 }
@@ -195,9 +188,13 @@ cleanup_bowls()
     sem_destroy( mutex );
     mutex = NULL;
   }
-  if (perf_mutex != NULL) {
-    sem_destroy( perf_mutex );
-    perf_mutex = NULL;
+  if (cat_wait_hist != NULL) {
+    hist_destroy( cat_wait_hist );
+    cat_wait_hist = NULL;
+  }
+  if (mouse_wait_hist != NULL) {
+    hist_destroy( mouse_wait_hist );
+    mouse_wait_hist = NULL;
   }
   if (bowls != NULL) {
     kfree( (void *) bowls );
@@ -463,15 +460,7 @@ cat_simulation(void * unusedpointer,
 
     /* update wait time statistics */
     getinterval(before_sec,before_nsec,after_sec,after_nsec,&wait_sec,&wait_nsec);
-    P(perf_mutex);
-    cat_total_wait_secs += wait_sec;
-    cat_total_wait_nsecs += wait_nsec;
-    if (cat_total_wait_nsecs > 1000000000) {
-      cat_total_wait_nsecs -= 1000000000;
-      cat_total_wait_secs ++;
-    }
-    cat_wait_count++;
-    V(perf_mutex);
+    hist_record(cat_wait_hist, (uint64_t)wait_sec*1000000000 + wait_nsec);
   }
 
   /* indicate that this cat simulation is finished */
@@ -526,21 +515,48 @@ mouse_simulation(void * unusedpointer,
 
     /* update wait time statistics */
     getinterval(before_sec,before_nsec,after_sec,after_nsec,&wait_sec,&wait_nsec);
-    P(perf_mutex);
-    mouse_total_wait_secs += wait_sec;
-    mouse_total_wait_nsecs += wait_nsec;
-    if (mouse_total_wait_nsecs > 1000000000) {
-      mouse_total_wait_nsecs -= 1000000000;
-      mouse_total_wait_secs ++;
-    }
-    mouse_wait_count++;
-    V(perf_mutex);
+    hist_record(mouse_wait_hist, (uint64_t)wait_sec*1000000000 + wait_nsec);
   }
 
   /* indicate that this mouse is finished */
   V(CatMouseWait); 
 }
 
+/*
+ * report_waits()
+ *
+ * Arguments:
+ *      const char *who: "cat" or "mouse".
+ *      struct histogram *h: the waits to report.
+ *
+ * Returns:
+ *      nothing.
+ *
+ * Notes:
+ *      prints the mean wait, as before, then the median, 99th
+ *      percentile and longest wait, then the histogram's summary line
+ */
+
+static
+void
+report_waits(const char *who, struct histogram *h)
+{
+  int mean_usecs, p50_usecs, p99_usecs, max_usecs;
+
+  if (hist_count(h) == 0) {
+    return;
+  }
+  mean_usecs = hist_mean(h)/1000;
+  p50_usecs = hist_percentile(h, 50)/1000;
+  p99_usecs = hist_percentile(h, 99)/1000;
+  max_usecs = hist_max(h)/1000;
+  kprintf("Mean %s waiting time: %d.%d seconds\n",who,mean_usecs/1000000,mean_usecs%1000000);
+  kprintf("Median %s waiting time: %d.%06d seconds\n",who,p50_usecs/1000000,p50_usecs%1000000);
+  kprintf("99th percentile %s waiting time: %d.%06d seconds\n",who,p99_usecs/1000000,p99_usecs%1000000);
+  kprintf("Longest %s waiting time: %d.%06d seconds\n",who,max_usecs/1000000,max_usecs%1000000);
+  hist_print(h);
+}
+
 /*
  * catmouse()
  *
@@ -570,7 +586,6 @@ catmouse(int nargs,
 {
   int catindex, mouseindex, error;
   int i;
-  int mean_cat_wait_usecs, mean_mouse_wait_usecs;
   time_t before_sec, after_sec, wait_sec;
   uint32_t before_nsec, after_nsec, wait_nsec;
   int total_bowl_milliseconds, total_eating_milliseconds, utilization_percent;
@@ -701,20 +716,13 @@ catmouse(int nargs,
   /* clean up the synchronization state */
   catmouse_sync_cleanup(NumBowls);
 
+  /* report the statistics before the histograms go away */
+  report_waits("cat", cat_wait_hist);
+  report_waits("mouse", mouse_wait_hist);
+
   /* clean up resources used for tracking bowl use */
   cleanup_bowls();
 
-  if (cat_wait_count > 0) {
-    /* some rounding error here - not significant if cat_wait_count << 1000000 */
-    mean_cat_wait_usecs = (cat_total_wait_secs*1000000+cat_total_wait_nsecs/1000)/cat_wait_count;
-    kprintf("Mean cat waiting time: %d.%d seconds\n",mean_cat_wait_usecs/1000000,mean_cat_wait_usecs%1000000);
-  }
-  if (mouse_wait_count > 0) {
-    /* some rounding error here - not significant if mouse_wait_count << 1000000 */
-    mean_mouse_wait_usecs = (mouse_total_wait_secs*1000000+mouse_total_wait_nsecs/1000)/mouse_wait_count;
-    kprintf("Mean mouse waiting time: %d.%d seconds\n",mean_mouse_wait_usecs/1000000,mean_mouse_wait_usecs%1000000);
-  }
-
   return 0;
 }
 
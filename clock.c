@@ -34,6 +34,10 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <kern/errno.h>
+#include <spinlock.h>
+#include <counter.h>
+#include <cpus.h>
 
 /*
  * Time handling.
@@ -58,16 +62,115 @@
  */
 static struct wchan *lbolt;
 
+/*
+ * Monotonic clock: nanoseconds since boot, never going backwards even
+ * if the time of day does.
+ */
+static struct spinlock mono_lock = SPINLOCK_INITIALIZER;
+static uint64_t mono_base;		/* time of day at first use, in ns */
+static uint64_t mono_last;		/* largest value handed out */
+
+/*
+ * Threads in clock_sleepns wait on a per-CPU queue of deadlines kept
+ * in deadline order, so hardclock only has to look at the head. Each
+ * sleeper has its own wait channel, so expiring one wakes only that
+ * thread.
+ */
+struct clocksleeper {
+	uint64_t cs_deadline;		/* monotonic ns */
+	struct wchan *cs_wchan;
+	volatile bool cs_done;		/* set when the deadline passes */
+	struct clocksleeper *cs_next;
+};
+
+static struct {
+	struct spinlock dq_lock;
+	struct clocksleeper *dq_head;	/* earliest deadline first */
+} deadlineq[PCPU_MAXCPUS];
+
 /*
  * Setup.
  */
 void
 hardclock_bootstrap(void)
 {
+	unsigned i;
+
 	lbolt = wchan_create("lbolt");
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+
+	/* no clock device yet; clock_monotonic_ns sets the base */
+	mono_base = 0;
+	mono_last = 0;
+
+	for (i=0; i<PCPU_MAXCPUS; i++) {
+		spinlock_init(&deadlineq[i].dq_lock);
+		deadlineq[i].dq_head = NULL;
+	}
+}
+
+/*
+ * Nanoseconds since boot.
+ */
+uint64_t
+clock_monotonic_ns(void)
+{
+	time_t secs;
+	uint32_t nsecs;
+	uint64_t now;
+
+	gettime(&secs, &nsecs);
+	now = (uint64_t)secs * 1000000000 + nsecs;
+
+	spinlock_acquire(&mono_lock);
+	if (mono_base == 0) {
+		/* first call, from the first clock tick at the latest */
+		mono_base = now;
+	}
+	now = now > mono_base ? now - mono_base : 0;
+	if (now < mono_last) {
+		now = mono_last;
+	}
+	else {
+		mono_last = now;
+	}
+	spinlock_release(&mono_lock);
+
+	return now;
+}
+
+/*
+ * Wake everyone on this CPU's deadline queue whose time has come.
+ * Called from hardclock.
+ */
+static
+void
+clock_expire(void)
+{
+	struct clocksleeper *cs;
+	unsigned me;
+	uint64_t now;
+
+	me = curcpu->c_number;
+	KASSERT(me < PCPU_MAXCPUS);
+
+	/* unlocked peek; the common case is that nobody is sleeping */
+	if (deadlineq[me].dq_head == NULL) {
+		return;
+	}
+
+	now = clock_monotonic_ns();
+
+	spinlock_acquire(&deadlineq[me].dq_lock);
+	while ((cs = deadlineq[me].dq_head) != NULL &&
+	       cs->cs_deadline <= now) {
+		deadlineq[me].dq_head = cs->cs_next;
+		cs->cs_done = true;
+		wchan_wakeone(cs->cs_wchan);
+	}
+	spinlock_release(&deadlineq[me].dq_lock);
 }
 
 /*
@@ -93,6 +196,12 @@ hardclock(void)
 	 */
 
 	curcpu->c_hardclocks++;
+	pcpu_counter_inc(&kstat_hardclocks);
+	clock_expire();
+	if (!cpus_isonline(curcpu->c_self)) {
+		/* parked; there is nothing here to schedule */
+		return;
+	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
@@ -114,3 +223,59 @@ clocksleep(int num_secs)
 		num_secs--;
 	}
 }
+
+/*
+ * Suspend execution for NSECS nanoseconds. The sleep ends on the
+ * first clock tick at or after the deadline, so it is rounded up to
+ * the tick interval.
+ *
+ * The sleeper goes on the queue of whichever CPU it happens to be on
+ * when it starts. Which queue it is does not matter for correctness,
+ * only that the same one is used throughout, and where the thread
+ * runs afterward makes no difference.
+ */
+int
+clock_sleepns(uint64_t nsecs)
+{
+	struct clocksleeper cs, **pp;
+	unsigned me;
+
+	if (nsecs == 0) {
+		thread_yield();
+		return 0;
+	}
+
+	cs.cs_wchan = wchan_create("clocksleep");
+	if (cs.cs_wchan == NULL) {
+		return ENOMEM;
+	}
+	cs.cs_deadline = clock_monotonic_ns() + nsecs;
+	cs.cs_done = false;
+
+	me = curcpu->c_number;
+	KASSERT(me < PCPU_MAXCPUS);
+
+	spinlock_acquire(&deadlineq[me].dq_lock);
+	for (pp = &deadlineq[me].dq_head;
+	     *pp != NULL && (*pp)->cs_deadline <= cs.cs_deadline;
+	     pp = &(*pp)->cs_next) {
+		/* nothing */
+	}
+	cs.cs_next = *pp;
+	*pp = &cs;
+
+	/*
+	 * Lock the channel before letting go of the queue, so that
+	 * clock_expire cannot wake us before we are asleep.
+	 */
+	while (!cs.cs_done) {
+		wchan_lock(cs.cs_wchan);
+		spinlock_release(&deadlineq[me].dq_lock);
+		wchan_sleep(cs.cs_wchan);
+		spinlock_acquire(&deadlineq[me].dq_lock);
+	}
+	spinlock_release(&deadlineq[me].dq_lock);
+
+	wchan_destroy(cs.cs_wchan);
+	return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Kernel-side console output buffer. See conbuf.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <thread.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <conbuf.h>
+
+/* Most the drain thread hands the device in one VOP_WRITE. */
+#define CONBUF_BATCH	1024
+
+static struct {
+	struct lock *cb_lock;		/* protects everything below */
+	struct cv *cb_space;		/* signalled when room is freed */
+	struct cv *cb_data;		/* signalled when data is added */
+	struct cv *cb_done;		/* signalled when a batch is written */
+	char cb_buf[CONBUF_SIZE];
+	unsigned cb_head;		/* next byte to drain */
+	unsigned cb_count;		/* bytes buffered */
+	uint64_t cb_appended;		/* bytes ever appended */
+	uint64_t cb_written;		/* bytes ever written to the device */
+	struct vnode *cb_vnode;		/* the console */
+} conbuf;
+
+/*
+ * The drain thread. Takes whatever has accumulated (up to
+ * CONBUF_BATCH bytes) and writes it to the device in one call, with
+ * the buffer unlocked so writers can keep appending meanwhile.
+ */
+static
+void
+conbuf_drain(void *junk, unsigned long junk2)
+{
+	char batch[CONBUF_BATCH];
+	struct iovec iov;
+	struct uio ku;
+	unsigned len, first;
+	int result;
+
+	(void)junk;
+	(void)junk2;
+
+	lock_acquire(conbuf.cb_lock);
+	while (1) {
+		while (conbuf.cb_count == 0) {
+			cv_wait(conbuf.cb_data, conbuf.cb_lock);
+		}
+
+		len = conbuf.cb_count;
+		if (len > CONBUF_BATCH) {
+			len = CONBUF_BATCH;
+		}
+		first = CONBUF_SIZE - conbuf.cb_head;
+		if (first > len) {
+			first = len;
+		}
+		memcpy(batch, conbuf.cb_buf + conbuf.cb_head, first);
+		memcpy(batch + first, conbuf.cb_buf, len - first);
+		conbuf.cb_head = (conbuf.cb_head + len) % CONBUF_SIZE;
+		conbuf.cb_count -= len;
+		cv_broadcast(conbuf.cb_space, conbuf.cb_lock);
+		lock_release(conbuf.cb_lock);
+
+		uio_kinit(&iov, &ku, batch, len, 0, UIO_WRITE);
+		result = VOP_WRITE(conbuf.cb_vnode, &ku);
+		if (result) {
+			kprintf("conbuf: console write failed: %s\n",
+				strerror(result));
+		}
+
+		lock_acquire(conbuf.cb_lock);
+		conbuf.cb_written += len;
+		cv_broadcast(conbuf.cb_done, conbuf.cb_lock);
+	}
+}
+
+void
+conbuf_bootstrap(void)
+{
+	char path[5];
+	int result;
+
+	conbuf.cb_lock = lock_create("conbuf");
+	conbuf.cb_space = cv_create("conbuf space");
+	conbuf.cb_data = cv_create("conbuf data");
+	conbuf.cb_done = cv_create("conbuf done");
+	if (conbuf.cb_lock == NULL || conbuf.cb_space == NULL ||
+	    conbuf.cb_data == NULL || conbuf.cb_done == NULL) {
+		panic("conbuf_bootstrap: out of memory\n");
+	}
+	conbuf.cb_head = 0;
+	conbuf.cb_count = 0;
+	conbuf.cb_appended = 0;
+	conbuf.cb_written = 0;
+
+	/* vfs_open destroys its argument */
+	strcpy(path, "con:");
+	result = vfs_open(path, O_WRONLY, 0, &conbuf.cb_vnode);
+	if (result) {
+		panic("conbuf_bootstrap: could not open console: %s\n",
+		      strerror(result));
+	}
+
+	result = thread_fork("conbuf drain", NULL, conbuf_drain, NULL, 0);
+	if (result) {
+		panic("conbuf_bootstrap: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+}
+
+/*
+ * Device vnodes are shared by every open of the device, so comparing
+ * against our own open of con: identifies the console.
+ */
+bool
+conbuf_isconsole(struct vnode *v)
+{
+	return conbuf.cb_vnode != NULL && v == conbuf.cb_vnode;
+}
+
+/*
+ * Append the data in UIO (user or kernel space) to the buffer, one
+ * CONBUF_ATOMIC-sized piece at a time. The copy from the caller's
+ * memory is done before taking the buffer lock, since it may fault;
+ * each piece then goes into the ring in a single critical section.
+ */
+int
+conbuf_write(struct uio *uio, uint64_t *seq)
+{
+	char piece[CONBUF_ATOMIC];
+	unsigned len, tail, first;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+
+	*seq = 0;
+	while (uio->uio_resid > 0) {
+		len = uio->uio_resid;
+		if (len > CONBUF_ATOMIC) {
+			len = CONBUF_ATOMIC;
+		}
+		result = uiomove(piece, len, uio);
+		if (result) {
+			return result;
+		}
+
+		lock_acquire(conbuf.cb_lock);
+		while (CONBUF_SIZE - conbuf.cb_count < len) {
+			cv_wait(conbuf.cb_space, conbuf.cb_lock);
+		}
+		tail = (conbuf.cb_head + conbuf.cb_count) % CONBUF_SIZE;
+		first = CONBUF_SIZE - tail;
+		if (first > len) {
+			first = len;
+		}
+		memcpy(conbuf.cb_buf + tail, piece, first);
+		memcpy(conbuf.cb_buf, piece + first, len - first);
+		conbuf.cb_count += len;
+		conbuf.cb_appended += len;
+		*seq = conbuf.cb_appended;
+		cv_signal(conbuf.cb_data, conbuf.cb_lock);
+		lock_release(conbuf.cb_lock);
+	}
+	return 0;
+}
+
+/*
+ * Wait for the drain thread to get past SEQ. Bytes reach the device
+ * in order, so this waits for nothing appended after SEQ.
+ */
+void
+conbuf_flush_to(uint64_t seq)
+{
+	if (conbuf.cb_lock == NULL) {
+		/* not bootstrapped yet; nothing can be buffered */
+		return;
+	}
+
+	lock_acquire(conbuf.cb_lock);
+	KASSERT(seq <= conbuf.cb_appended);
+	while (conbuf.cb_written < seq) {
+		cv_wait(conbuf.cb_done, conbuf.cb_lock);
+	}
+	lock_release(conbuf.cb_lock);
+}
+
+void
+conbuf_flush(void)
+{
+	uint64_t seq;
+
+	if (conbuf.cb_lock == NULL) {
+		return;
+	}
+
+	lock_acquire(conbuf.cb_lock);
+	seq = conbuf.cb_appended;
+	lock_release(conbuf.cb_lock);
+
+	conbuf_flush_to(seq);
+}
@@ -0,0 +1,47 @@
+#ifndef _CONBUF_H_
+#define _CONBUF_H_
+
+/*
+ * Kernel-side console output buffer.
+ *
+ * User writes to the console are copied into a ring buffer and
+ * drained to the console device by a dedicated kernel thread, so a
+ * writing process only pays for the copy, and many small writes from
+ * many processes reach the device in large batches.
+ *
+ * Each write of up to CONBUF_ATOMIC bytes is appended to the buffer
+ * in one piece and therefore never interleaves with output from any
+ * other write. Longer writes are appended in CONBUF_ATOMIC-sized
+ * pieces and may interleave with others at piece boundaries.
+ *
+ * Functions:
+ *     conbuf_bootstrap  - open the console and start the drain thread.
+ *     conbuf_isconsole  - true if V is the console device vnode.
+ *     conbuf_write      - append the data described by UIO; returns
+ *                         once it is buffered, not once it is printed.
+ *                         Sets *SEQ to the sequence number just past
+ *                         the last byte appended.
+ *     conbuf_flush_to   - wait until every byte before sequence number
+ *                         SEQ has been written to the device.
+ *     conbuf_flush      - wait until everything buffered so far has
+ *                         been written to the device.
+ *
+ * Sequence numbers count bytes appended since boot. A process keeps
+ * the one from its last write, so at exit it waits for its own output
+ * (and whatever was queued ahead of it) and not for writers that are
+ * still going.
+ */
+
+#define CONBUF_SIZE	4096	/* ring buffer size */
+#define CONBUF_ATOMIC	512	/* writes up to this size are atomic */
+
+struct uio;
+struct vnode;
+
+void conbuf_bootstrap(void);
+bool conbuf_isconsole(struct vnode *v);
+int conbuf_write(struct uio *uio, uint64_t *seq);
+void conbuf_flush_to(uint64_t seq);
+void conbuf_flush(void);
+
+#endif /* _CONBUF_H_ */
@@ -0,0 +1,189 @@
+/*
+ * Per-CPU sharded counters. See counter.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <counter.h>
+
+/*
+ * Kernel statistics.
+ */
+struct pcpu_counter kstat_switches = PCPU_COUNTER_INITIALIZER("switches");
+struct pcpu_counter kstat_hardclocks = PCPU_COUNTER_INITIALIZER("hardclocks");
+struct pcpu_counter kstat_thread_forks = PCPU_COUNTER_INITIALIZER("thread_forks");
+struct pcpu_counter kstat_ipis = PCPU_COUNTER_INITIALIZER("ipis");
+struct pcpu_counter kstat_ipis_coalesced = PCPU_COUNTER_INITIALIZER("ipis_coalesced");
+struct pcpu_counter kstat_smpcalls = PCPU_COUNTER_INITIALIZER("smpcalls");
+struct pcpu_counter kstat_elfcache_hits = PCPU_COUNTER_INITIALIZER("elfcache_hits");
+struct pcpu_counter kstat_elfcache_misses = PCPU_COUNTER_INITIALIZER("elfcache_misses");
+struct pcpu_counter kstat_as_activates = PCPU_COUNTER_INITIALIZER("as_activates");
+
+static struct pcpu_counter *const kstats[] = {
+	&kstat_switches,
+	&kstat_hardclocks,
+	&kstat_thread_forks,
+	&kstat_ipis,
+	&kstat_ipis_coalesced,
+	&kstat_smpcalls,
+	&kstat_elfcache_hits,
+	&kstat_elfcache_misses,
+	&kstat_as_activates,
+	NULL
+};
+
+/*
+ * Create a counter.
+ *
+ * struct pcpu_counter is larger than the biggest kmalloc subpage
+ * size, so it comes back page-aligned and the per-slot alignment
+ * declared in counter.h actually holds.
+ */
+struct pcpu_counter *
+pcpu_counter_create(const char *name)
+{
+	struct pcpu_counter *pc;
+	unsigned i;
+
+	COMPILE_ASSERT(sizeof(struct pcpu_slot) == PCPU_CACHELINE);
+
+	pc = kmalloc(sizeof(*pc));
+	if (pc == NULL) {
+		return NULL;
+	}
+	KASSERT(((vaddr_t)pc->pc_slots & (PCPU_CACHELINE - 1)) == 0);
+
+	pc->pc_name = name;
+	spinlock_init(&pc->pc_lock);
+	pc->pc_base = 0;
+	for (i=0; i<PCPU_MAXCPUS; i++) {
+		pc->pc_slots[i].ps_seq = 0;
+		pc->pc_slots[i].ps_value = 0;
+	}
+	return pc;
+}
+
+void
+pcpu_counter_destroy(struct pcpu_counter *pc)
+{
+	KASSERT(pc != NULL);
+	spinlock_cleanup(&pc->pc_lock);
+	kfree(pc);
+}
+
+/*
+ * Add to the current CPU's slot. Interrupts are off for the duration
+ * so we can neither be preempted nor migrate between reading curcpu
+ * and writing the slot; nobody else writes this slot, so no lock is
+ * needed.
+ */
+void
+pcpu_counter_add(struct pcpu_counter *pc, uint64_t n)
+{
+	struct pcpu_slot *ps;
+	int spl;
+
+	spl = splhigh();
+	KASSERT(curcpu->c_number < PCPU_MAXCPUS);
+	ps = &pc->pc_slots[curcpu->c_number];
+	ps->ps_seq++;
+	ps->ps_value += n;
+	ps->ps_seq++;
+	splx(spl);
+}
+
+void
+pcpu_counter_inc(struct pcpu_counter *pc)
+{
+	pcpu_counter_add(pc, 1);
+}
+
+/*
+ * Read one slot without catching it halfway through an update.
+ */
+static
+uint64_t
+pcpu_slot_read(const struct pcpu_slot *ps)
+{
+	uint32_t seq;
+	uint64_t value;
+
+	do {
+		seq = ps->ps_seq;
+		value = ps->ps_value;
+	} while ((seq & 1) || ps->ps_seq != seq);
+
+	return value;
+}
+
+/*
+ * Sum of all the slots since the counter was created.
+ */
+static
+uint64_t
+pcpu_counter_fold(struct pcpu_counter *pc)
+{
+	uint64_t total;
+	unsigned i;
+
+	total = 0;
+	for (i=0; i<PCPU_MAXCPUS; i++) {
+		total += pcpu_slot_read(&pc->pc_slots[i]);
+	}
+	return total;
+}
+
+/*
+ * Fold all the slots. See the note in counter.h about staleness.
+ */
+uint64_t
+pcpu_counter_read(struct pcpu_counter *pc)
+{
+	uint64_t total;
+
+	total = pcpu_counter_fold(pc);
+	spinlock_acquire(&pc->pc_lock);
+	total -= pc->pc_base;
+	spinlock_release(&pc->pc_lock);
+	return total;
+}
+
+void
+pcpu_counter_reset(struct pcpu_counter *pc)
+{
+	uint64_t total;
+
+	total = pcpu_counter_fold(pc);
+	spinlock_acquire(&pc->pc_lock);
+	pc->pc_base = total;
+	spinlock_release(&pc->pc_lock);
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Print all kernel statistics.
+ */
+void
+kstat_print(void)
+{
+	unsigned i;
+
+	for (i=0; kstats[i] != NULL; i++) {
+		kprintf("%-16s %llu\n", kstats[i]->pc_name,
+			(unsigned long long) pcpu_counter_read(kstats[i]));
+	}
+}
+
+void
+kstat_reset(void)
+{
+	unsigned i;
+
+	for (i=0; kstats[i] != NULL; i++) {
+		pcpu_counter_reset(kstats[i]);
+	}
+}
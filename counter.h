@@ -0,0 +1,93 @@
+#ifndef _COUNTER_H_
+#define _COUNTER_H_
+
+#include <spinlock.h>
+
+/*
+ * Per-CPU sharded counters.
+ *
+ * A pcpu_counter keeps one slot per CPU, each on its own cache line,
+ * so that increments from different CPUs never touch the same line
+ * and never take a lock. An increment turns interrupts off on the
+ * current CPU just long enough to update that CPU's slot; since a
+ * thread cannot be preempted or migrated with interrupts off, the
+ * slot is only ever written by its own CPU.
+ *
+ * Reading folds all the slots together. A slot is 64 bits, which
+ * takes two loads on a 32-bit machine, so each slot also has a
+ * sequence count: its CPU makes the count odd while it changes the
+ * value, and a reader retries until it sees the same even count
+ * before and after loading the value. No slot is ever read half
+ * updated. The fold as a whole is still not atomic with respect to
+ * concurrent increments, so the result is a snapshot that may be
+ * slightly stale; that is fine for statistics, which is what these
+ * are for. Do not use them for anything that needs an exact value
+ * while other CPUs are still counting.
+ *
+ * Since only its own CPU may write a slot, resetting a counter does
+ * not touch the slots: it remembers the current total in pc_base,
+ * and reads subtract that.
+ *
+ * Functions:
+ *     pcpu_counter_create  - allocate a counter, initially zero.
+ *     pcpu_counter_destroy - free it.
+ *     pcpu_counter_add     - add N to the current CPU's slot.
+ *     pcpu_counter_inc     - add 1.
+ *     pcpu_counter_read    - fold all slots and return the total.
+ *     pcpu_counter_reset   - zero all slots.
+ *
+ * Counters that live for the whole life of the kernel can be
+ * declared statically with PCPU_COUNTER_INITIALIZER instead of being
+ * allocated; kernel statistics (kstat_*) work this way.
+ */
+
+/* Upper bound on CPUs; System/161 supports at most 32. */
+#define PCPU_MAXCPUS		32
+
+/* Size of a cache line; slots are padded out to this. */
+#define PCPU_CACHELINE		64
+
+struct pcpu_slot {
+	volatile uint32_t ps_seq;	/* odd while ps_value is changing */
+	volatile uint64_t ps_value;
+} __attribute__((aligned(PCPU_CACHELINE)));
+
+struct pcpu_counter {
+	const char *pc_name;
+	struct spinlock pc_lock;	/* protects pc_base */
+	uint64_t pc_base;		/* total as of the last reset */
+	struct pcpu_slot pc_slots[PCPU_MAXCPUS];
+};
+
+#define PCPU_COUNTER_INITIALIZER(name) \
+	{ (name), SPINLOCK_INITIALIZER, 0, { { 0, 0 } } }
+
+struct pcpu_counter *pcpu_counter_create(const char *name);
+void pcpu_counter_destroy(struct pcpu_counter *pc);
+
+void pcpu_counter_add(struct pcpu_counter *pc, uint64_t n);
+void pcpu_counter_inc(struct pcpu_counter *pc);
+uint64_t pcpu_counter_read(struct pcpu_counter *pc);
+void pcpu_counter_reset(struct pcpu_counter *pc);
+
+
+/*
+ * Kernel statistics. These are statically allocated per-CPU counters
+ * bumped from hot paths (context switches, timer ticks, IPIs, ...).
+ * kstat_print() dumps them all; it backs the "ks" menu command.
+ */
+extern struct pcpu_counter kstat_switches;
+extern struct pcpu_counter kstat_hardclocks;
+extern struct pcpu_counter kstat_thread_forks;
+extern struct pcpu_counter kstat_ipis;
+extern struct pcpu_counter kstat_ipis_coalesced;	/* IPIs not needed */
+extern struct pcpu_counter kstat_smpcalls;	/* cross-CPU calls run */
+extern struct pcpu_counter kstat_elfcache_hits;		/* execs found cached */
+extern struct pcpu_counter kstat_elfcache_misses;	/* execs parsed */
+extern struct pcpu_counter kstat_as_activates;	/* TLB reloads on switch */
+
+void kstat_print(void);
+void kstat_reset(void);
+
+
+#endif /* _COUNTER_H_ */
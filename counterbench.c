@@ -0,0 +1,156 @@
+/*
+ * Benchmark for per-CPU counters.
+ *
+ * Runs NTHREADS threads that each bump a shared counter ITERS times,
+ * first with the counter protected by a semaphore and then with a
+ * pcpu_counter, and reports increments per second for both. Run with
+ * increasing thread counts (up to and past the number of CPUs) to see
+ * how each one scales.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <test.h>
+#include <counter.h>
+#include <bench.h>
+
+#define DEFAULT_THREADS	4
+#define DEFAULT_ITERS	100000
+
+static struct semaphore *cb_start;	/* releases the workers together */
+static struct semaphore *cb_done;	/* workers signal when finished */
+static struct semaphore *cb_mutex;	/* protects cb_semcount */
+static volatile uint64_t cb_semcount;
+static struct pcpu_counter *cb_pcpucount;
+static unsigned long cb_iters;
+
+static
+void
+semcount_thread(void *junk, unsigned long num)
+{
+	unsigned long i;
+
+	(void)junk;
+	(void)num;
+
+	P(cb_start);
+	for (i=0; i<cb_iters; i++) {
+		P(cb_mutex);
+		cb_semcount++;
+		V(cb_mutex);
+	}
+	V(cb_done);
+}
+
+static
+void
+pcpucount_thread(void *junk, unsigned long num)
+{
+	unsigned long i;
+
+	(void)junk;
+	(void)num;
+
+	P(cb_start);
+	for (i=0; i<cb_iters; i++) {
+		pcpu_counter_inc(cb_pcpucount);
+	}
+	V(cb_done);
+}
+
+/*
+ * Fork NTHREADS copies of FUNC, let them go at once, and wait for all
+ * of them. Prints the throughput under the name NAME.
+ */
+static
+void
+counterbench_run(const char *name, unsigned nthreads,
+		 void (*func)(void *, unsigned long))
+{
+	time_t s1, s2, secs;
+	uint32_t ns1, ns2, nsecs;
+	uint64_t ns, rate;
+	unsigned i;
+	int result;
+
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("counterbench", NULL, func, NULL, i);
+		if (result) {
+			panic("counterbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	gettime(&s1, &ns1);
+	for (i=0; i<nthreads; i++) {
+		V(cb_start);
+	}
+	for (i=0; i<nthreads; i++) {
+		P(cb_done);
+	}
+	gettime(&s2, &ns2);
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+
+	ns = (uint64_t)secs * 1000000000 + nsecs;
+	rate = ns > 0 ? (uint64_t)nthreads * cb_iters * 1000000000 / ns : 0;
+	kprintf("counterbench %s threads=%u incs=%llu "
+		"time=%lu.%09lu incs_per_sec=%llu\n",
+		name, nthreads,
+		(unsigned long long)((uint64_t)nthreads * cb_iters),
+		(unsigned long)secs, (unsigned long)nsecs,
+		(unsigned long long)rate);
+}
+
+/*
+ * Usage: pcb [maxthreads [iterations]]
+ *
+ * Runs both variants for 1, 2, 4, ... up to maxthreads threads.
+ */
+int
+counterbench(int nargs, char **args)
+{
+	unsigned maxthreads, n;
+
+	maxthreads = DEFAULT_THREADS;
+	cb_iters = DEFAULT_ITERS;
+	if (nargs > 1) {
+		maxthreads = atoi(args[1]);
+	}
+	if (nargs > 2) {
+		cb_iters = atoi(args[2]);
+	}
+	if (nargs > 3 || maxthreads == 0 || cb_iters == 0) {
+		kprintf("Usage: pcb [maxthreads [iterations]]\n");
+		return EINVAL;
+	}
+
+	cb_start = sem_create("counterbench start", 0);
+	cb_done = sem_create("counterbench done", 0);
+	cb_mutex = sem_create("counterbench mutex", 1);
+	cb_pcpucount = pcpu_counter_create("counterbench");
+	if (cb_start == NULL || cb_done == NULL || cb_mutex == NULL ||
+	    cb_pcpucount == NULL) {
+		panic("counterbench: out of memory\n");
+	}
+
+	for (n=1; n<=maxthreads; n*=2) {
+		cb_semcount = 0;
+		counterbench_run("sem", n, semcount_thread);
+		KASSERT(cb_semcount == (uint64_t)n * cb_iters);
+
+		pcpu_counter_reset(cb_pcpucount);
+		counterbench_run("pcpu", n, pcpucount_thread);
+		KASSERT(pcpu_counter_read(cb_pcpucount) ==
+			(uint64_t)n * cb_iters);
+	}
+
+	pcpu_counter_destroy(cb_pcpucount);
+	sem_destroy(cb_mutex);
+	sem_destroy(cb_done);
+	sem_destroy(cb_start);
+	return 0;
+}
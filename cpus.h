@@ -0,0 +1,47 @@
+#ifndef _CPUS_H_
+#define _CPUS_H_
+
+/*
+ * The set of CPUs.
+ *
+ * thread.c owns the array of all CPUs; these let other code walk it
+ * without reaching into thread.c.
+ *
+ * Functions:
+ *     cpus_count    - number of CPUs, including ones not yet started.
+ *     cpus_get      - CPU number I, for 0 <= I < cpus_count().
+ *
+ * CPUs can also be taken out of service and brought back while the
+ * system runs, to shrink the set of active CPUs when there is little
+ * to do, or to shut down cleanly. An offline CPU runs no threads:
+ * whatever was queued on it moves to the other CPUs, and threads
+ * that last ran there are woken elsewhere. It still takes
+ * interrupts, so cross-CPU calls and its own timekeeping keep
+ * working.
+ *
+ *     cpus_isonline - true unless C has been taken offline.
+ *     cpus_offline  - take C offline, waiting until its threads have
+ *                     been handed off. Fails with EBUSY if C is the
+ *                     last online CPU. May sleep.
+ *     cpus_online   - bring C back.
+ *
+ * thread_fork_cpu is thread_fork, except that the new thread starts
+ * on CPU C (or an online one, if C is offline) instead of the
+ * caller's CPU. The scheduler may still migrate it later.
+ */
+
+struct cpu;
+
+unsigned cpus_count(void);
+struct cpu *cpus_get(unsigned i);
+
+bool cpus_isonline(struct cpu *c);
+int cpus_offline(struct cpu *c);
+int cpus_online(struct cpu *c);
+
+struct proc;
+int thread_fork_cpu(const char *name, struct proc *proc, struct cpu *c,
+		    void (*entrypoint)(void *data1, unsigned long data2),
+		    void *data1, unsigned long data2);
+
+#endif /* _CPUS_H_ */
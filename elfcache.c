@@ -0,0 +1,303 @@
+/*
+ * Exec cache. See elfcache.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <counter.h>
+#include <elfmap.h>
+#include <elfcache.h>
+
+struct elfcache_entry {
+	struct elfmap *ce_map;
+	struct elfcache_entry *ce_prev;	/* toward the hot end */
+	struct elfcache_entry *ce_next;	/* toward the cold end */
+};
+
+static struct lock *elfcache_lock;	/* protects the list */
+static struct elfcache_entry *elfcache_head;	/* most recently used */
+static struct elfcache_entry *elfcache_tail;	/* least recently used */
+static unsigned elfcache_nentries;
+
+/*
+ * One bit per hash of each cached vnode, and of each vnode that is
+ * being parsed to go in the cache, so that elfcache_invalidate can
+ * tell without elfcache_lock that a file (nearly always one that is
+ * not a program at all) is of no interest. Only written with the lock
+ * held.
+ */
+#define ELFCACHE_NHASH	32
+static volatile uint32_t elfcache_vnodes;
+
+/*
+ * For each hash value, the number of parses under way, and a count
+ * of invalidations. A parse notes the count before it reads the file
+ * and only caches what it read if the count has not moved since, so
+ * a write that lands while a program is being parsed cannot leave
+ * the old contents in the cache. Protected by elfcache_lock.
+ */
+static unsigned elfcache_loading[ELFCACHE_NHASH];
+static unsigned elfcache_gens[ELFCACHE_NHASH];
+
+void
+elfcache_bootstrap(void)
+{
+	elfcache_lock = lock_create("elfcache");
+	if (elfcache_lock == NULL) {
+		panic("elfcache_bootstrap: out of memory\n");
+	}
+	elfcache_head = elfcache_tail = NULL;
+	elfcache_nentries = 0;
+	elfcache_vnodes = 0;
+}
+
+static
+unsigned
+elfcache_hash(struct vnode *v)
+{
+	vaddr_t x;
+
+	/* vnodes are kmalloc'd, so the low bits carry nothing */
+	x = (vaddr_t)v >> 4;
+	return (x ^ (x >> 5) ^ (x >> 10)) % ELFCACHE_NHASH;
+}
+
+static
+uint32_t
+elfcache_vnodebit(struct vnode *v)
+{
+	return (uint32_t)1 << elfcache_hash(v);
+}
+
+////////////////////////////////////////////////////////////
+//
+// List handling. These require elfcache_lock.
+
+/*
+ * Recompute elfcache_vnodes from the list.
+ */
+static
+void
+elfcache_setvnodes(void)
+{
+	struct elfcache_entry *ce;
+	uint32_t bits;
+	unsigned i;
+
+	KASSERT(lock_do_i_hold(elfcache_lock));
+
+	bits = 0;
+	for (ce = elfcache_head; ce != NULL; ce = ce->ce_next) {
+		bits |= elfcache_vnodebit(ce->ce_map->em_vnode);
+	}
+	for (i=0; i<ELFCACHE_NHASH; i++) {
+		if (elfcache_loading[i] > 0) {
+			bits |= (uint32_t)1 << i;
+		}
+	}
+	elfcache_vnodes = bits;
+}
+
+static
+void
+elfcache_unlink(struct elfcache_entry *ce)
+{
+	KASSERT(lock_do_i_hold(elfcache_lock));
+
+	if (ce->ce_prev != NULL) {
+		ce->ce_prev->ce_next = ce->ce_next;
+	}
+	else {
+		elfcache_head = ce->ce_next;
+	}
+	if (ce->ce_next != NULL) {
+		ce->ce_next->ce_prev = ce->ce_prev;
+	}
+	else {
+		elfcache_tail = ce->ce_prev;
+	}
+	ce->ce_prev = ce->ce_next = NULL;
+	elfcache_nentries--;
+	elfcache_setvnodes();
+}
+
+static
+void
+elfcache_pushhead(struct elfcache_entry *ce)
+{
+	KASSERT(lock_do_i_hold(elfcache_lock));
+
+	ce->ce_prev = NULL;
+	ce->ce_next = elfcache_head;
+	if (elfcache_head != NULL) {
+		elfcache_head->ce_prev = ce;
+	}
+	else {
+		elfcache_tail = ce;
+	}
+	elfcache_head = ce;
+	elfcache_nentries++;
+	elfcache_vnodes |= elfcache_vnodebit(ce->ce_map->em_vnode);
+}
+
+static
+struct elfcache_entry *
+elfcache_find(struct vnode *v)
+{
+	struct elfcache_entry *ce;
+
+	KASSERT(lock_do_i_hold(elfcache_lock));
+
+	for (ce = elfcache_head; ce != NULL; ce = ce->ce_next) {
+		if (ce->ce_map->em_vnode == v) {
+			return ce;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Get rid of an entry that has already been unlinked. This can sleep
+ * (dropping the last reference to a vnode may), so it is done without
+ * elfcache_lock.
+ */
+static
+void
+elfcache_destroy(struct elfcache_entry *ce)
+{
+	elfmap_decref(ce->ce_map);
+	kfree(ce);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Interface.
+
+int
+elfcache_get(struct vnode *v, struct elfmap **ret)
+{
+	struct elfcache_entry *ce, *victim;
+	struct elfmap *em;
+	unsigned h, gen;
+	int result;
+
+	lock_acquire(elfcache_lock);
+	ce = elfcache_find(v);
+	if (ce != NULL) {
+		/* hit: move to the hot end */
+		elfcache_unlink(ce);
+		elfcache_pushhead(ce);
+		elfmap_incref(ce->ce_map);
+		*ret = ce->ce_map;
+		lock_release(elfcache_lock);
+		pcpu_counter_inc(&kstat_elfcache_hits);
+		return 0;
+	}
+
+	/* from here on writes to V have to come and tell us */
+	h = elfcache_hash(v);
+	elfcache_loading[h]++;
+	elfcache_vnodes |= elfcache_vnodebit(v);
+	gen = elfcache_gens[h];
+	lock_release(elfcache_lock);
+
+	pcpu_counter_inc(&kstat_elfcache_misses);
+
+	/* parse without the lock; this reads the file */
+	result = load_elfmap(v, &em);
+	ce = NULL;
+	if (result == 0) {
+		/* if this fails we can still run it, just not cache it */
+		ce = kmalloc(sizeof(*ce));
+	}
+
+	/*
+	 * Stop being a parse in progress and go in the cache in one
+	 * step, so there is no moment when a write could slip past
+	 * elfcache_vnodes unseen.
+	 */
+	victim = NULL;
+	lock_acquire(elfcache_lock);
+	KASSERT(elfcache_loading[h] > 0);
+	elfcache_loading[h]--;
+	if (result || ce == NULL || elfcache_gens[h] != gen ||
+	    elfcache_find(v) != NULL) {
+		/*
+		 * Failed, or V may have changed under the parse, or
+		 * someone else cached it while we were parsing. In the
+		 * last case ours is just as good, and the cached one
+		 * will be found next time.
+		 */
+		elfcache_setvnodes();
+		lock_release(elfcache_lock);
+		kfree(ce);
+		if (result == 0) {
+			*ret = em;
+		}
+		return result;
+	}
+	ce->ce_map = em;
+
+	/* the cache keeps the reference from load_elfmap */
+	elfmap_incref(em);
+	elfcache_pushhead(ce);
+
+	if (elfcache_nentries > ELFCACHE_MAXENTRIES) {
+		victim = elfcache_tail;
+		elfcache_unlink(victim);
+	}
+	lock_release(elfcache_lock);
+
+	if (victim != NULL) {
+		elfcache_destroy(victim);
+	}
+
+	*ret = em;
+	return 0;
+}
+
+void
+elfcache_invalidate(struct vnode *v)
+{
+	struct elfcache_entry *ce;
+
+	if ((elfcache_vnodes & elfcache_vnodebit(v)) == 0) {
+		/* not cached; don't make every write take the lock */
+		return;
+	}
+
+	lock_acquire(elfcache_lock);
+	/* tell any parse of V (or of a vnode with the same hash) */
+	elfcache_gens[elfcache_hash(v)]++;
+	ce = elfcache_find(v);
+	if (ce != NULL) {
+		elfcache_unlink(ce);
+	}
+	lock_release(elfcache_lock);
+
+	if (ce != NULL) {
+		elfcache_destroy(ce);
+	}
+}
+
+void
+elfcache_flush(void)
+{
+	struct elfcache_entry *ce;
+
+	while (1) {
+		lock_acquire(elfcache_lock);
+		ce = elfcache_tail;
+		if (ce != NULL) {
+			elfcache_unlink(ce);
+		}
+		lock_release(elfcache_lock);
+
+		if (ce == NULL) {
+			break;
+		}
+		elfcache_destroy(ce);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef _ELFCACHE_H_
+#define _ELFCACHE_H_
+
+/*
+ * Exec cache.
+ *
+ * Keeps the parsed form (an elfmap; see elfmap.h) of recently run
+ * executables, keyed by vnode, so that running the same program again
+ * does not re-read and re-check its headers.
+ *
+ * The cache holds one reference to each cached elfmap, and through it
+ * to the vnode; vnodes are unique per file, so a later vfs_open of the
+ * same program finds the entry. Entries are kept in LRU order; at
+ * most ELFCACHE_MAXENTRIES programs are kept, and going over evicts
+ * from the cold end.
+ *
+ * Functions:
+ *     elfcache_bootstrap  - set up at boot.
+ *     elfcache_get        - return in RET a referenced elfmap for
+ *                           executable V, parsing it on a miss.
+ *     elfcache_invalidate - forget V; call after V's contents change.
+ *                           Cheap when V is not cached.
+ *     elfcache_flush      - evict everything, so that no vnode is held
+ *                           open by the cache (for shutdown).
+ */
+
+struct vnode;
+struct elfmap;
+
+#define ELFCACHE_MAXENTRIES	32
+
+void elfcache_bootstrap(void);
+int elfcache_get(struct vnode *v, struct elfmap **ret);
+void elfcache_invalidate(struct vnode *v);
+void elfcache_flush(void);
+
+#endif /* _ELFCACHE_H_ */
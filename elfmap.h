@@ -0,0 +1,62 @@
+#ifndef _ELFMAP_H_
+#define _ELFMAP_H_
+
+/*
+ * Parsed executables.
+ *
+ * An elfmap is what load_elf needs from an executable's headers: the
+ * entry point and, for each loadable segment, where it goes in
+ * memory and where it lives in the file. load_elf defines a region
+ * for each segment and reads them in from that, without looking at
+ * the headers again, so that the exec cache (elfcache.h) can keep
+ * elfmaps for programs that are run over and over.
+ *
+ * An elfmap holds a reference to the executable's vnode for as long
+ * as it exists, so the vnode cannot be freed and its address reused
+ * for another file while the map is cached. It is reference counted:
+ * every exec of a program in the exec cache shares the cached one,
+ * and the last user destroys it.
+ *
+ * Functions:
+ *     elfmap_create   - make an empty map for vnode V.
+ *     elfmap_addseg   - record one PT_LOAD segment.
+ *     elfmap_incref   - add a reference.
+ *     elfmap_decref   - drop a reference; the last one frees the map.
+ *
+ * load_elfmap parses an executable into a new elfmap; it is what the
+ * exec cache calls on a miss.
+ */
+
+#include <spinlock.h>
+
+struct vnode;
+
+/* Most executables have three segments; don't bother with more. */
+#define ELFMAP_MAXSEGS	8
+
+struct elfseg {
+	vaddr_t es_vaddr;		/* where the segment starts */
+	size_t es_memsize;		/* its size in memory */
+	size_t es_filesize;		/* how much of that is in the file */
+	off_t es_offset;		/* where in the file it is */
+	uint32_t es_flags;		/* PF_R, PF_W, PF_X */
+};
+
+struct elfmap {
+	struct vnode *em_vnode;		/* the executable */
+	vaddr_t em_entry;		/* entry point */
+	unsigned em_nsegs;
+	struct elfseg em_segs[ELFMAP_MAXSEGS];
+	struct spinlock em_lock;	/* protects em_refcount */
+	unsigned em_refcount;
+};
+
+struct elfmap *elfmap_create(struct vnode *v);
+int elfmap_addseg(struct elfmap *em, off_t offset, vaddr_t vaddr,
+		  size_t memsize, size_t filesize, uint32_t flags);
+void elfmap_incref(struct elfmap *em);
+void elfmap_decref(struct elfmap *em);
+
+int load_elfmap(struct vnode *v, struct elfmap **ret);
+
+#endif /* _ELFMAP_H_ */
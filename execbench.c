@@ -0,0 +1,78 @@
+/*
+ * execbench.c
+ *
+ * User-level exec latency benchmark. Not part of the kernel: build it
+ * as a testbin program.
+ *
+ * Usage: execbench [iterations [program]]
+ *
+ * Runs PROGRAM (default /testbin/huge) ITERATIONS times (default 20)
+ * with fork and execv, waiting for each, and prints the mean time per
+ * fork+exec+exit. PROGRAM is started with the single argument
+ * "execbench", so use something that exits promptly.
+ *
+ * Run "ks reset" at the kernel menu before the run and "ks" after it:
+ * with the exec cache, every exec after the first should count as an
+ * elfcache_hit rather than an elfcache_miss.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#define DEFAULT_ITERS	20
+#define DEFAULT_PROGRAM	"/testbin/huge"
+
+int
+main(int argc, char *argv[])
+{
+	char *args[3];
+	int iters = DEFAULT_ITERS;
+	unsigned long long ns;
+	time_t s1, s2;
+	unsigned long ns1, ns2;
+	pid_t pid;
+	int i, status;
+
+	args[0] = (char *)DEFAULT_PROGRAM;
+	args[1] = (char *)"execbench";
+	args[2] = NULL;
+
+	if (argc > 1) {
+		iters = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		args[0] = argv[2];
+	}
+	if (argc > 3 || iters <= 0) {
+		errx(1, "Usage: execbench [iterations [program]]");
+	}
+
+	__time(&s1, &ns1);
+	for (i=0; i<iters; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			execv(args[0], args);
+			_exit(255);
+		}
+		if (waitpid(pid, &status, 0) != pid) {
+			err(1, "waitpid %d", pid);
+		}
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 255) {
+			errx(1, "execv %s failed", args[0]);
+		}
+	}
+	__time(&s2, &ns2);
+
+	ns = (unsigned long long)(s2 - s1) * 1000000000ULL + ns2 - ns1;
+	printf("execbench program=%s iters=%d time_ns=%llu ns_per_exec=%llu\n",
+	       args[0], iters, ns, ns / iters);
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * exitbench.c
+ *
+ * User-level exit latency benchmark. Not part of the kernel: build it
+ * as a testbin program.
+ *
+ * Usage: exitbench [heap_kb [iterations]]
+ *
+ * Each iteration forks a child that allocates and touches HEAP_KB
+ * (default 2048) of memory, then notes the time and exits at once.
+ * The parent notes the time at which its waitpid returns. The child
+ * passes its timestamp back through a file, since there is no other
+ * way to get it out. The difference is how long it takes, from the
+ * moment a process calls _exit, for its parent to learn about it.
+ * Prints the mean, minimum and maximum over ITERATIONS (default 10)
+ * for the given heap size and, for comparison, for a tiny one.
+ *
+ * The stamp file is left behind, since we have no remove() yet.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <err.h>
+
+#define DEFAULT_HEAP_KB	2048
+#define DEFAULT_ITERS	10
+#define PAGESIZE	4096
+#define STAMPFILE	"emu0:exitbench.tmp"
+
+struct stamp {
+	time_t s;
+	unsigned long ns;
+};
+
+static
+void
+child(size_t heapsize)
+{
+	struct stamp st;
+	char *heap;
+	size_t i;
+	int fd;
+
+	fd = open(STAMPFILE, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		_exit(1);
+	}
+	heap = malloc(heapsize);
+	if (heap == NULL) {
+		_exit(2);
+	}
+	for (i=0; i<heapsize; i+=PAGESIZE) {
+		heap[i] = 1;
+	}
+
+	__time(&st.s, &st.ns);
+	if (write(fd, &st, sizeof(st)) != sizeof(st)) {
+		_exit(3);
+	}
+	_exit(0);
+}
+
+static
+void
+run(size_t heapsize, int iters)
+{
+	unsigned long long ns, total, min, max;
+	struct stamp st;
+	time_t s;
+	unsigned long nsec;
+	pid_t pid;
+	int i, fd, status;
+
+	total = max = 0;
+	min = ~0ULL;
+	for (i=0; i<iters; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			child(heapsize);
+		}
+		if (waitpid(pid, &status, 0) != pid) {
+			err(1, "waitpid %d", pid);
+		}
+		__time(&s, &nsec);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "child failed, status %d", status);
+		}
+
+		fd = open(STAMPFILE, O_RDONLY);
+		if (fd < 0) {
+			err(1, "%s", STAMPFILE);
+		}
+		if (read(fd, &st, sizeof(st)) != sizeof(st)) {
+			errx(1, "%s: short read", STAMPFILE);
+		}
+		close(fd);
+
+		ns = (unsigned long long)(s - st.s) * 1000000000ULL
+			+ nsec - st.ns;
+		total += ns;
+		if (ns < min) {
+			min = ns;
+		}
+		if (ns > max) {
+			max = ns;
+		}
+	}
+
+	printf("exitbench heap_kb=%lu iters=%d mean_ns=%llu min_ns=%llu "
+	       "max_ns=%llu\n", (unsigned long)(heapsize / 1024), iters,
+	       total / iters, min, max);
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t heapsize = DEFAULT_HEAP_KB * 1024;
+	int iters = DEFAULT_ITERS;
+
+	if (argc > 1) {
+		heapsize = atoi(argv[1]) * 1024;
+	}
+	if (argc > 2) {
+		iters = atoi(argv[2]);
+	}
+	if (argc > 3 || heapsize == 0 || iters <= 0) {
+		errx(1, "Usage: exitbench [heap_kb [iterations]]");
+	}
+
+	run(PAGESIZE, iters);
+	run(heapsize, iters);
+	return 0;
+}
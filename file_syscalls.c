@@ -1,5 +1,8 @@
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
 #include <kern/unistd.h>
 #include <lib.h>
 #include <uio.h>
@@ -8,8 +11,161 @@
 #include <vfs.h>
 #include <current.h>
 #include <proc.h>
+#include <synch.h>
+#include <copyinout.h>
+#if OPT_A2
+#include <kern/iovec.h>
+#include <limits.h>
+#include <filetable.h>
+#include <conbuf.h>
+#endif /* OPT_A2 */
+#if OPT_A3
+#include <elfcache.h>
+#endif /* OPT_A3 */
+
+#if OPT_A2
+/*
+ * Number of iovecs readv/writev handle without going to kmalloc.
+ */
+#define IOV_ONSTACK 8
+
+/*
+ * Largest total transfer readv/writev accept; the byte count is
+ * returned in an int.
+ */
+#define RWV_MAX ((size_t)0x7fffffff)
+
+/*
+ * Common code for read(), write(), readv() and writev(): look up
+ * FDESC, check that it was opened for RW, and move the IOVCNT
+ * segments in IOV (NBYTES in total) between user memory and the file
+ * at the open file's current offset, in a single VOP call.
+ *
+ * The open file's lock is held across the VOP call, so concurrent
+ * reads or writes through the same open file (e.g. in a parent and
+ * child after fork) see consistent offsets and do not overlap. Other
+ * open files, even of the same vnode, are not affected.
+ *
+ * Console writes are the exception: they go to the console buffer,
+ * which makes each write atomic by itself and returns as soon as the
+ * data is buffered, so no open file lock is needed.
+ */
+static
+int
+file_rw(int fdesc, struct iovec *iov, unsigned iovcnt, size_t nbytes,
+        enum uio_rw rw, int *retval)
+{
+        struct openfile *of;
+        struct uio u;
+        int res;
+
+        KASSERT(curproc != NULL);
+        KASSERT(curproc->p_filetable != NULL);
+        KASSERT(curproc->p_addrspace != NULL);
+
+        res = filetable_get(curproc->p_filetable, fdesc, &of);
+        if (res) {
+                return res;
+        }
+
+        if ((rw == UIO_READ && of->of_accmode == O_WRONLY) ||
+            (rw == UIO_WRITE && of->of_accmode == O_RDONLY)) {
+                openfile_decref(of);
+                return EBADF;
+        }
+
+        /* set up a uio structure to refer to the user program's buffers */
+        u.uio_iov = iov;
+        u.uio_iovcnt = iovcnt;
+        u.uio_offset = 0;
+        u.uio_resid = nbytes;
+        u.uio_segflg = UIO_USERSPACE;
+        u.uio_rw = rw;
+        u.uio_space = curproc->p_addrspace;
+
+        if (rw == UIO_WRITE && conbuf_isconsole(of->of_vnode)) {
+                uint64_t seq;
+
+                res = conbuf_write(&u, &seq);
+                openfile_decref(of);
+                if (res) {
+                        return res;
+                }
+                /* remember how far to flush when we exit */
+                spinlock_acquire(&curproc->p_filetable->ft_lock);
+                if (seq > curproc->p_filetable->ft_conseq) {
+                        curproc->p_filetable->ft_conseq = seq;
+                }
+                spinlock_release(&curproc->p_filetable->ft_lock);
+                *retval = nbytes - u.uio_resid;
+                return 0;
+        }
+
+        lock_acquire(of->of_lock);
+        u.uio_offset = of->of_offset;
+
+        if (rw == UIO_WRITE && of->of_append) {
+                /* O_APPEND: every write goes at the current end, even
+                   if the file grew through another open of it */
+                struct stat st;
+
+                res = VOP_STAT(of->of_vnode, &st);
+                if (res) {
+                        lock_release(of->of_lock);
+                        openfile_decref(of);
+                        return res;
+                }
+                u.uio_offset = st.st_size;
+        }
+
+        if (rw == UIO_READ) {
+                res = VOP_READ(of->of_vnode, &u);
+        } else {
+                res = VOP_WRITE(of->of_vnode, &u);
+#if OPT_A3
+                /* don't let later execs use a stale parse of the file;
+                   even a failed write may have changed some of it */
+                elfcache_invalidate(of->of_vnode);
+#endif /* OPT_A3 */
+        }
+        if (res == 0) {
+                /* the console is not seekable; its offset stays 0 */
+                of->of_offset = u.uio_offset;
+        }
+
+        lock_release(of->of_lock);
+        openfile_decref(of);
+
+        if (res) {
+                return res;
+        }
+
+        /* pass back the number of bytes actually transferred */
+        *retval = nbytes - u.uio_resid;
+        KASSERT(*retval >= 0);
+        return 0;
+}
+#endif /* OPT_A2 */
 
 /* handler for write() system call                  */
+#if OPT_A2
+/*
+ * Writes go through the process's file table to whatever the
+ * descriptor refers to. Writes through one open file are serialized
+ * by its lock.
+ */
+int
+sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
+{
+  struct iovec iov;
+
+  DEBUG(DB_SYSCALL,"Syscall: write(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+  iov.iov_ubase = ubuf;
+  iov.iov_len = nbytes;
+  return file_rw(fdesc, &iov, 1, nbytes, UIO_WRITE, retval);
+}
+#else
 /*
  * n.b.
  * This implementation handles only writes to standard output 
@@ -58,3 +214,202 @@ sys_write(int fdesc,userptr_t ubuf,unsigned int nbytes,int *retval)
   KASSERT(*retval >= 0);
   return 0;
 }
+#endif /* OPT_A2 */
+
+#if OPT_A2
+/* handler for read() system call */
+int
+sys_read(int fdesc, userptr_t ubuf, unsigned int nbytes, int *retval)
+{
+        struct iovec iov;
+
+        DEBUG(DB_SYSCALL,"Syscall: read(%d,%x,%d)\n",fdesc,(unsigned int)ubuf,nbytes);
+
+        iov.iov_ubase = ubuf;
+        iov.iov_len = nbytes;
+        return file_rw(fdesc, &iov, 1, nbytes, UIO_READ, retval);
+}
+
+/*
+ * Common code for readv() and writev(): copy in the user's iovec
+ * array and hand all of it to file_rw as one multi-segment uio, so a
+ * scatter/gather operation costs one trap and one VOP call.
+ */
+static
+int
+file_rwv(int fdesc, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+         int *retval)
+{
+        struct iovec iovstack[IOV_ONSTACK];
+        struct iovec *iov;
+        size_t total;
+        int i, result;
+
+        if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+                return EINVAL;
+        }
+
+        if (iovcnt <= IOV_ONSTACK) {
+                iov = iovstack;
+        } else {
+                iov = kmalloc(iovcnt * sizeof(struct iovec));
+                if (iov == NULL) {
+                        return ENOMEM;
+                }
+        }
+
+        result = copyin(uiov, iov, iovcnt * sizeof(struct iovec));
+        if (result) {
+                goto out;
+        }
+
+        /* the total must fit in the int we return */
+        total = 0;
+        for (i = 0; i < iovcnt; ++i) {
+                if (iov[i].iov_len > RWV_MAX - total) {
+                        result = EINVAL;
+                        goto out;
+                }
+                total += iov[i].iov_len;
+        }
+
+        result = file_rw(fdesc, iov, iovcnt, total, rw, retval);
+
+ out:
+        if (iov != iovstack) {
+                kfree(iov);
+        }
+        return result;
+}
+
+/* handler for readv() system call */
+int
+sys_readv(int fdesc, const_userptr_t uiov, int iovcnt, int *retval)
+{
+        DEBUG(DB_SYSCALL,"Syscall: readv(%d,%x,%d)\n",fdesc,(unsigned int)uiov,iovcnt);
+
+        return file_rwv(fdesc, uiov, iovcnt, UIO_READ, retval);
+}
+
+/* handler for writev() system call */
+int
+sys_writev(int fdesc, const_userptr_t uiov, int iovcnt, int *retval)
+{
+        DEBUG(DB_SYSCALL,"Syscall: writev(%d,%x,%d)\n",fdesc,(unsigned int)uiov,iovcnt);
+
+        return file_rwv(fdesc, uiov, iovcnt, UIO_WRITE, retval);
+}
+
+/* handler for open() system call */
+int
+sys_open(userptr_t upath, int flags, mode_t mode, int *retval)
+{
+        char path[PATH_MAX];
+        struct openfile *of;
+        int result;
+
+        KASSERT(curproc->p_filetable != NULL);
+
+        if ((flags & O_ACCMODE) != O_RDONLY &&
+            (flags & O_ACCMODE) != O_WRONLY &&
+            (flags & O_ACCMODE) != O_RDWR) {
+                return EINVAL;
+        }
+
+        result = copyinstr((const_userptr_t)upath, path, sizeof(path), NULL);
+        if (result) {
+                return result;
+        }
+
+        result = openfile_open(path, flags, mode, &of);
+        if (result) {
+                return result;
+        }
+
+        result = filetable_place(curproc->p_filetable, of, retval);
+        if (result) {
+                openfile_decref(of);
+                return result;
+        }
+        return 0;
+}
+
+/* handler for close() system call */
+int
+sys_close(int fdesc)
+{
+        KASSERT(curproc->p_filetable != NULL);
+
+        return filetable_close(curproc->p_filetable, fdesc);
+}
+
+/* handler for lseek() system call */
+int
+sys_lseek(int fdesc, off_t pos, int whence, off_t *retval)
+{
+        struct openfile *of;
+        struct stat st;
+        off_t newpos;
+        int result;
+
+        KASSERT(curproc->p_filetable != NULL);
+
+        result = filetable_get(curproc->p_filetable, fdesc, &of);
+        if (result) {
+                return result;
+        }
+
+        if (!VOP_ISSEEKABLE(of->of_vnode)) {
+                openfile_decref(of);
+                return ESPIPE;
+        }
+
+        lock_acquire(of->of_lock);
+        switch (whence) {
+            case SEEK_SET:
+                newpos = pos;
+                break;
+            case SEEK_CUR:
+                newpos = of->of_offset + pos;
+                break;
+            case SEEK_END:
+                result = VOP_STAT(of->of_vnode, &st);
+                if (result) {
+                        goto out;
+                }
+                newpos = st.st_size + pos;
+                break;
+            default:
+                result = EINVAL;
+                goto out;
+        }
+
+        if (newpos < 0) {
+                result = EINVAL;
+                goto out;
+        }
+        of->of_offset = newpos;
+        *retval = newpos;
+
+ out:
+        lock_release(of->of_lock);
+        openfile_decref(of);
+        return result;
+}
+
+/* handler for dup2() system call */
+int
+sys_dup2(int oldfd, int newfd, int *retval)
+{
+        int result;
+
+        KASSERT(curproc->p_filetable != NULL);
+
+        result = filetable_dup2(curproc->p_filetable, oldfd, newfd);
+        if (result) {
+                return result;
+        }
+        *retval = newfd;
+        return 0;
+}
+#endif /* OPT_A2 */
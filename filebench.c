@@ -0,0 +1,124 @@
+/*
+ * filebench.c
+ *
+ * User-level read/write throughput benchmark for the file syscalls.
+ * Not part of the kernel: build it as a testbin program.
+ *
+ * Usage: filebench [file [kbytes]]
+ *
+ * Writes KBYTES (default 1024) to FILE (default "emu0:filebench.tmp")
+ * with each of a range of buffer sizes, then reads it back, and
+ * prints the throughput of each pass. Removing the file afterwards is
+ * left to the user, since we have no remove() yet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <err.h>
+
+#define DEFAULT_FILE	"emu0:filebench.tmp"
+#define DEFAULT_KBYTES	1024
+#define MAXBUF		16384
+
+static char buf[MAXBUF];
+
+static const int bufsizes[] = { 512, 1024, 4096, 16384, 0 };
+
+/* Nanoseconds between two __time() readings. */
+static
+unsigned long long
+elapsed(time_t s1, unsigned long ns1, time_t s2, unsigned long ns2)
+{
+	return (unsigned long long)(s2 - s1) * 1000000000ULL + ns2 - ns1;
+}
+
+static
+void
+report(const char *what, int bufsize, unsigned long long bytes,
+       unsigned long long ns)
+{
+	unsigned long long kbps;
+
+	kbps = ns > 0 ? bytes * 1000000000ULL / 1024 / ns : 0;
+	printf("filebench %s bufsize=%d bytes=%llu time_ns=%llu kb_per_sec=%llu\n",
+	       what, bufsize, bytes, ns, kbps);
+}
+
+static
+void
+pass(const char *file, int bufsize, unsigned long long total)
+{
+	unsigned long long done;
+	time_t s1, s2;
+	unsigned long ns1, ns2;
+	int fd, r;
+
+	/* write */
+	fd = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open for write", file);
+	}
+	__time(&s1, &ns1);
+	for (done = 0; done < total; done += r) {
+		r = write(fd, buf, bufsize);
+		if (r < 0) {
+			err(1, "%s: write", file);
+		}
+		if (r == 0) {
+			errx(1, "%s: short write", file);
+		}
+	}
+	__time(&s2, &ns2);
+	close(fd);
+	report("write", bufsize, done, elapsed(s1, ns1, s2, ns2));
+
+	/* read it back */
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s: open for read", file);
+	}
+	__time(&s1, &ns1);
+	for (done = 0; done < total; done += r) {
+		r = read(fd, buf, bufsize);
+		if (r < 0) {
+			err(1, "%s: read", file);
+		}
+		if (r == 0) {
+			errx(1, "%s: unexpected EOF", file);
+		}
+	}
+	__time(&s2, &ns2);
+	close(fd);
+	report("read", bufsize, done, elapsed(s1, ns1, s2, ns2));
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *file = DEFAULT_FILE;
+	unsigned long long total = DEFAULT_KBYTES * 1024ULL;
+	int i;
+
+	if (argc > 1) {
+		file = argv[1];
+	}
+	if (argc > 2) {
+		total = atoi(argv[2]) * 1024ULL;
+	}
+	if (argc > 3 || total == 0) {
+		errx(1, "Usage: filebench [file [kbytes]]");
+	}
+
+	for (i=0; i<MAXBUF; i++) {
+		buf[i] = 'a' + i % 26;
+	}
+
+	for (i=0; bufsizes[i] != 0; i++) {
+		pass(file, bufsizes[i], total);
+	}
+	return 0;
+}
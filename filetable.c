@@ -0,0 +1,302 @@
+/*
+ * Per-process file descriptor tables. See filetable.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/unistd.h>
+#include <lib.h>
+#include <synch.h>
+#include <vnode.h>
+#include <vfs.h>
+#include <filetable.h>
+#if OPT_A3
+#include <elfcache.h>
+#endif /* OPT_A3 */
+
+////////////////////////////////////////////////////////////
+//
+// Open files.
+
+/*
+ * Open PATH and wrap it in a new openfile with one reference.
+ *
+ * Like vfs_open, this may destroy PATH.
+ */
+int
+openfile_open(char *path, int flags, mode_t mode, struct openfile **ret)
+{
+	struct openfile *of;
+	struct vnode *v;
+	int result;
+
+	of = kmalloc(sizeof(*of));
+	if (of == NULL) {
+		return ENOMEM;
+	}
+
+	of->of_lock = lock_create("openfile");
+	if (of->of_lock == NULL) {
+		kfree(of);
+		return ENOMEM;
+	}
+
+	result = vfs_open(path, flags, mode, &v);
+	if (result) {
+		lock_destroy(of->of_lock);
+		kfree(of);
+		return result;
+	}
+#if OPT_A3
+	if (flags & O_TRUNC) {
+		/* the program, if it was one, is gone */
+		elfcache_invalidate(v);
+	}
+#endif /* OPT_A3 */
+
+	of->of_vnode = v;
+	of->of_accmode = flags & O_ACCMODE;
+	of->of_append = (flags & O_APPEND) != 0;
+	of->of_offset = 0;
+	spinlock_init(&of->of_reflock);
+	of->of_refcount = 1;
+
+	*ret = of;
+	return 0;
+}
+
+void
+openfile_incref(struct openfile *of)
+{
+	spinlock_acquire(&of->of_reflock);
+	of->of_refcount++;
+	spinlock_release(&of->of_reflock);
+}
+
+/*
+ * Drop a reference; the last one closes the vnode.
+ */
+void
+openfile_decref(struct openfile *of)
+{
+	unsigned count;
+
+	spinlock_acquire(&of->of_reflock);
+	KASSERT(of->of_refcount > 0);
+	count = --of->of_refcount;
+	spinlock_release(&of->of_reflock);
+
+	if (count > 0) {
+		return;
+	}
+
+	vfs_close(of->of_vnode);
+	spinlock_cleanup(&of->of_reflock);
+	lock_destroy(of->of_lock);
+	kfree(of);
+}
+
+////////////////////////////////////////////////////////////
+//
+// File tables.
+
+struct filetable *
+filetable_create(void)
+{
+	struct filetable *ft;
+	int fd;
+
+	ft = kmalloc(sizeof(*ft));
+	if (ft == NULL) {
+		return NULL;
+	}
+	spinlock_init(&ft->ft_lock);
+	for (fd=0; fd<OPEN_MAX; fd++) {
+		ft->ft_files[fd] = NULL;
+	}
+	ft->ft_conseq = 0;
+	return ft;
+}
+
+/*
+ * Close everything and free the table. The table must no longer be
+ * reachable from its process.
+ */
+void
+filetable_destroy(struct filetable *ft)
+{
+	int fd;
+
+	for (fd=0; fd<OPEN_MAX; fd++) {
+		if (ft->ft_files[fd] != NULL) {
+			openfile_decref(ft->ft_files[fd]);
+			ft->ft_files[fd] = NULL;
+		}
+	}
+	spinlock_cleanup(&ft->ft_lock);
+	kfree(ft);
+}
+
+/*
+ * Make a copy of SRC for a child process. The openfiles themselves
+ * are shared, not duplicated, so parent and child share offsets.
+ */
+int
+filetable_copy(struct filetable *src, struct filetable **ret)
+{
+	struct filetable *ft;
+	struct openfile *of;
+	int fd;
+
+	ft = filetable_create();
+	if (ft == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&src->ft_lock);
+	for (fd=0; fd<OPEN_MAX; fd++) {
+		of = src->ft_files[fd];
+		if (of != NULL) {
+			openfile_incref(of);
+		}
+		ft->ft_files[fd] = of;
+	}
+	spinlock_release(&src->ft_lock);
+
+	*ret = ft;
+	return 0;
+}
+
+/*
+ * Set up stdin, stdout and stderr on the console for a fresh
+ * process.
+ */
+int
+filetable_init_console(struct filetable *ft)
+{
+	static const int modes[3] = { O_RDONLY, O_WRONLY, O_WRONLY };
+	struct openfile *of;
+	char path[5];
+	int fd, result;
+
+	KASSERT(STDIN_FILENO == 0);
+	KASSERT(STDOUT_FILENO == 1);
+	KASSERT(STDERR_FILENO == 2);
+
+	for (fd=0; fd<3; fd++) {
+		/* vfs_open destroys its argument */
+		strcpy(path, "con:");
+		result = openfile_open(path, modes[fd], 0, &of);
+		if (result) {
+			return result;
+		}
+
+		spinlock_acquire(&ft->ft_lock);
+		KASSERT(ft->ft_files[fd] == NULL);
+		ft->ft_files[fd] = of;
+		spinlock_release(&ft->ft_lock);
+	}
+	return 0;
+}
+
+int
+filetable_get(struct filetable *ft, int fd, struct openfile **ret)
+{
+	struct openfile *of;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	of = ft->ft_files[fd];
+	if (of != NULL) {
+		openfile_incref(of);
+	}
+	spinlock_release(&ft->ft_lock);
+
+	if (of == NULL) {
+		return EBADF;
+	}
+	*ret = of;
+	return 0;
+}
+
+/*
+ * Install OF at the lowest free descriptor. On success the table
+ * owns the caller's reference to OF.
+ */
+int
+filetable_place(struct filetable *ft, struct openfile *of, int *fd)
+{
+	int i;
+
+	spinlock_acquire(&ft->ft_lock);
+	for (i=0; i<OPEN_MAX; i++) {
+		if (ft->ft_files[i] == NULL) {
+			ft->ft_files[i] = of;
+			spinlock_release(&ft->ft_lock);
+			*fd = i;
+			return 0;
+		}
+	}
+	spinlock_release(&ft->ft_lock);
+	return EMFILE;
+}
+
+int
+filetable_close(struct filetable *ft, int fd)
+{
+	struct openfile *of;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	of = ft->ft_files[fd];
+	ft->ft_files[fd] = NULL;
+	spinlock_release(&ft->ft_lock);
+
+	if (of == NULL) {
+		return EBADF;
+	}
+	/* may sleep in vfs_close, so not under the spinlock */
+	openfile_decref(of);
+	return 0;
+}
+
+/*
+ * Make NEWFD refer to the same openfile as OLDFD, closing whatever
+ * NEWFD referred to before.
+ */
+int
+filetable_dup2(struct filetable *ft, int oldfd, int newfd)
+{
+	struct openfile *of, *old;
+
+	if (oldfd < 0 || oldfd >= OPEN_MAX || newfd < 0 || newfd >= OPEN_MAX) {
+		return EBADF;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	of = ft->ft_files[oldfd];
+	if (of == NULL) {
+		spinlock_release(&ft->ft_lock);
+		return EBADF;
+	}
+	if (oldfd == newfd) {
+		spinlock_release(&ft->ft_lock);
+		return 0;
+	}
+	openfile_incref(of);
+	old = ft->ft_files[newfd];
+	ft->ft_files[newfd] = of;
+	spinlock_release(&ft->ft_lock);
+
+	if (old != NULL) {
+		openfile_decref(old);
+	}
+	return 0;
+}
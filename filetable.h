@@ -0,0 +1,64 @@
+#ifndef _FILETABLE_H_
+#define _FILETABLE_H_
+
+/*
+ * Per-process file descriptor tables.
+ *
+ * An openfile is one open of a vnode: it carries the access mode and
+ * the seek position. File descriptors are slots in a process's
+ * filetable that point at openfiles. Several descriptors can share
+ * an openfile (after dup2, or in a parent and child after fork), and
+ * then they share the seek position too, as in Unix.
+ *
+ * Locking: each filetable has a spinlock that protects its slots and
+ * is only held long enough to look up or install an openfile and
+ * adjust its reference count. Each openfile has its own sleep lock,
+ * held across a read, write or lseek so the offset update is atomic
+ * with respect to other users of the same openfile. There is no
+ * global lock; I/O on different openfiles proceeds in parallel.
+ */
+
+#include <limits.h>
+#include <spinlock.h>
+
+struct vnode;
+struct lock;
+
+struct openfile {
+	struct vnode *of_vnode;		/* the open vnode */
+	int of_accmode;			/* O_RDONLY, O_WRONLY, or O_RDWR */
+	bool of_append;			/* O_APPEND: write at the end */
+	off_t of_offset;		/* seek position */
+	struct lock *of_lock;		/* held across I/O; protects offset */
+	struct spinlock of_reflock;	/* protects of_refcount */
+	unsigned of_refcount;		/* number of fds + transient users */
+};
+
+struct filetable {
+	struct spinlock ft_lock;	/* protects ft_files and ft_conseq */
+	struct openfile *ft_files[OPEN_MAX];
+	uint64_t ft_conseq;		/* conbuf sequence of our last write */
+};
+
+/* Open files. */
+int openfile_open(char *path, int flags, mode_t mode, struct openfile **ret);
+void openfile_incref(struct openfile *of);
+void openfile_decref(struct openfile *of);
+
+/* Tables. */
+struct filetable *filetable_create(void);
+void filetable_destroy(struct filetable *ft);
+int filetable_copy(struct filetable *src, struct filetable **ret);
+int filetable_init_console(struct filetable *ft);
+
+/*
+ * filetable_get returns the openfile for FD with a reference held;
+ * the caller must drop it with openfile_decref when done. This keeps
+ * the openfile alive even if another thread closes FD meanwhile.
+ */
+int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
+int filetable_place(struct filetable *ft, struct openfile *of, int *fd);
+int filetable_close(struct filetable *ft, int fd);
+int filetable_dup2(struct filetable *ft, int oldfd, int newfd);
+
+#endif /* _FILETABLE_H_ */
@@ -0,0 +1,80 @@
+/*
+ * forkbench.c
+ *
+ * User-level fork/waitpid benchmark. Not part of the kernel: build it
+ * as a testbin program.
+ *
+ * Usage: forkbench [nchildren]
+ *
+ * Forks NCHILDREN children (default 2000) without waiting for any of
+ * them, so that by the end thousands of pids are live at once, then
+ * waits for all of them in order. Each child exits immediately with
+ * its index as its exit code, which the parent checks. Prints the
+ * per-operation cost of the fork phase and of the wait phase.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#define DEFAULT_CHILDREN	2000
+#define MAXCHILDREN		16384
+
+static pid_t pids[MAXCHILDREN];
+
+static
+unsigned long long
+elapsed(time_t s1, unsigned long ns1, time_t s2, unsigned long ns2)
+{
+	return (unsigned long long)(s2 - s1) * 1000000000ULL + ns2 - ns1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int n = DEFAULT_CHILDREN;
+	unsigned long long forkns, waitns;
+	time_t s1, s2, s3;
+	unsigned long ns1, ns2, ns3;
+	int i, status;
+
+	if (argc > 1) {
+		n = atoi(argv[1]);
+	}
+	if (argc > 2 || n <= 0 || n > MAXCHILDREN) {
+		errx(1, "Usage: forkbench [nchildren (1-%d)]", MAXCHILDREN);
+	}
+
+	__time(&s1, &ns1);
+	for (i=0; i<n; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork %d", i);
+		}
+		if (pids[i] == 0) {
+			_exit(i & 0xff);
+		}
+	}
+	__time(&s2, &ns2);
+
+	for (i=0; i<n; i++) {
+		if (waitpid(pids[i], &status, 0) != pids[i]) {
+			err(1, "waitpid %d", pids[i]);
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != (i & 0xff)) {
+			errx(1, "child %d: wrong exit status %d", i, status);
+		}
+	}
+	__time(&s3, &ns3);
+
+	forkns = elapsed(s1, ns1, s2, ns2);
+	waitns = elapsed(s2, ns2, s3, ns3);
+	printf("forkbench children=%d fork_ns=%llu ns_per_fork=%llu "
+	       "wait_ns=%llu ns_per_wait=%llu\n",
+	       n, forkns, forkns / n, waitns, waitns / n);
+	return 0;
+}
@@ -0,0 +1,339 @@
+/*
+ * Per-CPU latency histograms. See histogram.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <current.h>
+#include <counter.h>
+#include <cpus.h>
+#include <histogram.h>
+
+/*
+ * One CPU's buckets. Only that CPU writes them.
+ */
+struct hist_slot {
+	volatile uint64_t hs_count;
+	volatile uint64_t hs_sum;
+	volatile uint64_t hs_max;
+	volatile uint32_t hs_buckets[HIST_NBUCKETS];
+} __attribute__((aligned(PCPU_CACHELINE)));
+
+struct histogram {
+	const char *h_name;
+	unsigned h_ncpus;
+	struct hist_slot *h_slots;	/* one per CPU */
+};
+
+/*
+ * Which bucket VALUE goes in.
+ */
+static
+unsigned
+hist_bucket(uint64_t value)
+{
+	unsigned msb, shift;
+
+	if (value < HIST_SUB) {
+		return value;
+	}
+	for (msb = HIST_SUBBITS; msb < HIST_MAXBITS; msb++) {
+		if ((value >> (msb + 1)) == 0) {
+			break;
+		}
+	}
+	if (msb == HIST_MAXBITS) {
+		return HIST_NBUCKETS - 1;
+	}
+	shift = msb - HIST_SUBBITS;
+	return (msb - HIST_SUBBITS + 1) * HIST_SUB +
+		((value >> shift) & (HIST_SUB - 1));
+}
+
+/*
+ * The smallest and largest values that go in bucket B.
+ */
+static
+uint64_t
+hist_bucket_low(unsigned b)
+{
+	unsigned shift;
+
+	if (b < HIST_SUB) {
+		return b;
+	}
+	shift = b / HIST_SUB - 1;
+	return (uint64_t)(HIST_SUB + b % HIST_SUB) << shift;
+}
+
+static
+uint64_t
+hist_bucket_high(unsigned b)
+{
+	if (b < HIST_SUB) {
+		return b;
+	}
+	return hist_bucket_low(b) + ((uint64_t)1 << (b / HIST_SUB - 1)) - 1;
+}
+
+/*
+ * Total count in bucket B, over all CPUs.
+ */
+static
+uint64_t
+hist_fold_bucket(struct histogram *h, unsigned b)
+{
+	uint64_t total;
+	unsigned i;
+
+	total = 0;
+	for (i=0; i<h->h_ncpus; i++) {
+		total += h->h_slots[i].hs_buckets[b];
+	}
+	return total;
+}
+
+/*
+ * Sum of all values recorded, over all CPUs.
+ */
+static
+uint64_t
+hist_fold_sum(struct histogram *h)
+{
+	uint64_t total;
+	unsigned i;
+
+	total = 0;
+	for (i=0; i<h->h_ncpus; i++) {
+		total += h->h_slots[i].hs_sum;
+	}
+	return total;
+}
+
+////////////////////////////////////////////////////////////
+
+/*
+ * Create a histogram.
+ *
+ * The slot array is bigger than the smallest kmalloc subpage sizes,
+ * and larger blocks are aligned to their size, so the per-slot
+ * alignment holds.
+ */
+struct histogram *
+hist_create(const char *name)
+{
+	struct histogram *h;
+
+	h = kmalloc(sizeof(*h));
+	if (h == NULL) {
+		return NULL;
+	}
+	h->h_name = name;
+	h->h_ncpus = cpus_count();
+	h->h_slots = kmalloc(h->h_ncpus * sizeof(h->h_slots[0]));
+	if (h->h_slots == NULL) {
+		kfree(h);
+		return NULL;
+	}
+	KASSERT(((vaddr_t)h->h_slots & (PCPU_CACHELINE - 1)) == 0);
+
+	hist_reset(h);
+	return h;
+}
+
+void
+hist_destroy(struct histogram *h)
+{
+	KASSERT(h != NULL);
+	kfree(h->h_slots);
+	kfree(h);
+}
+
+/*
+ * Record into the current CPU's slot. As with pcpu_counter_add,
+ * interrupts are off so we stay on this CPU while we update it, and
+ * nobody else writes this slot, so no lock is needed.
+ */
+void
+hist_record(struct histogram *h, uint64_t value)
+{
+	struct hist_slot *hs;
+	unsigned b;
+	int spl;
+
+	b = hist_bucket(value);
+
+	spl = splhigh();
+	KASSERT(curcpu->c_number < h->h_ncpus);
+	hs = &h->h_slots[curcpu->c_number];
+	hs->hs_buckets[b]++;
+	hs->hs_count++;
+	hs->hs_sum += value;
+	if (value > hs->hs_max) {
+		hs->hs_max = value;
+	}
+	splx(spl);
+}
+
+/*
+ * Fold SRC into DST's slot for the current CPU, so that DST can
+ * still be recorded into meanwhile.
+ */
+void
+hist_merge(struct histogram *dst, struct histogram *src)
+{
+	struct hist_slot *hs;
+	uint64_t max;
+	unsigned b;
+	int spl;
+
+	KASSERT(dst != src);
+
+	spl = splhigh();
+	KASSERT(curcpu->c_number < dst->h_ncpus);
+	hs = &dst->h_slots[curcpu->c_number];
+	for (b=0; b<HIST_NBUCKETS; b++) {
+		hs->hs_buckets[b] += hist_fold_bucket(src, b);
+	}
+	hs->hs_count += hist_count(src);
+	hs->hs_sum += hist_fold_sum(src);
+	max = hist_max(src);
+	if (max > hs->hs_max) {
+		hs->hs_max = max;
+	}
+	splx(spl);
+}
+
+void
+hist_reset(struct histogram *h)
+{
+	struct hist_slot *hs;
+	unsigned i, b;
+
+	for (i=0; i<h->h_ncpus; i++) {
+		hs = &h->h_slots[i];
+		hs->hs_count = 0;
+		hs->hs_sum = 0;
+		hs->hs_max = 0;
+		for (b=0; b<HIST_NBUCKETS; b++) {
+			hs->hs_buckets[b] = 0;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+uint64_t
+hist_count(struct histogram *h)
+{
+	uint64_t total;
+	unsigned i;
+
+	total = 0;
+	for (i=0; i<h->h_ncpus; i++) {
+		total += h->h_slots[i].hs_count;
+	}
+	return total;
+}
+
+uint64_t
+hist_mean(struct histogram *h)
+{
+	uint64_t count;
+
+	count = hist_count(h);
+	return count == 0 ? 0 : hist_fold_sum(h) / count;
+}
+
+uint64_t
+hist_max(struct histogram *h)
+{
+	uint64_t max;
+	unsigned i;
+
+	max = 0;
+	for (i=0; i<h->h_ncpus; i++) {
+		if (h->h_slots[i].hs_max > max) {
+			max = h->h_slots[i].hs_max;
+		}
+	}
+	return max;
+}
+
+/*
+ * Find the bucket holding the value of rank ceil(COUNT * PCT / 100)
+ * and return its top.
+ */
+uint64_t
+hist_percentile(struct histogram *h, unsigned pct)
+{
+	uint64_t count, rank, seen, max;
+	unsigned b;
+
+	KASSERT(pct <= 100);
+
+	count = hist_count(h);
+	if (count == 0) {
+		return 0;
+	}
+	rank = (count * pct + 99) / 100;
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	max = hist_max(h);
+	seen = 0;
+	for (b=0; b<HIST_NBUCKETS; b++) {
+		seen += hist_fold_bucket(h, b);
+		if (seen >= rank) {
+			break;
+		}
+	}
+	if (b == HIST_NBUCKETS || hist_bucket_high(b) > max) {
+		/* top bucket, or values still arriving */
+		return max;
+	}
+	return hist_bucket_high(b);
+}
+
+void
+hist_print(struct histogram *h)
+{
+	kprintf("%s count=%llu mean_ns=%llu p50_ns=%llu p90_ns=%llu "
+		"p99_ns=%llu max_ns=%llu\n",
+		h->h_name,
+		(unsigned long long)hist_count(h),
+		(unsigned long long)hist_mean(h),
+		(unsigned long long)hist_percentile(h, 50),
+		(unsigned long long)hist_percentile(h, 90),
+		(unsigned long long)hist_percentile(h, 99),
+		(unsigned long long)hist_max(h));
+}
+
+void
+hist_dump(struct histogram *h)
+{
+	uint64_t n;
+	unsigned b;
+
+	kprintf("%s:\n", h->h_name);
+	for (b=0; b<HIST_NBUCKETS; b++) {
+		n = hist_fold_bucket(h, b);
+		if (n == 0) {
+			continue;
+		}
+		if (b == HIST_NBUCKETS - 1) {
+			kprintf("    %llu- ns: %llu\n",
+				(unsigned long long)hist_bucket_low(b),
+				(unsigned long long)n);
+		}
+		else {
+			kprintf("    %llu-%llu ns: %llu\n",
+				(unsigned long long)hist_bucket_low(b),
+				(unsigned long long)hist_bucket_high(b),
+				(unsigned long long)n);
+		}
+	}
+}
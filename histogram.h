@@ -0,0 +1,73 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+/*
+ * Per-CPU latency histograms.
+ *
+ * A mean says little about how long the unlucky waits were. A
+ * histogram records every value into a bucket, so percentiles and
+ * the worst case can be read back afterwards.
+ *
+ * Buckets are logarithmic, in the style of HdrHistogram: each power
+ * of two is split into HIST_SUB equal sub-buckets, so any value is
+ * placed within 1/HIST_SUB (12.5%) of itself no matter how large it
+ * is, and a few hundred buckets cover everything from 1 ns to over
+ * a minute. Values below HIST_SUB get a bucket each; values past the
+ * top all land in the last bucket.
+ *
+ * Like a pcpu_counter, a histogram keeps a separate set of buckets
+ * for each CPU, and recording a value only touches the current CPU's
+ * set, with interrupts off just long enough to update it. There is
+ * no lock, and no cache line is shared between CPUs while recording.
+ * Queries fold all the sets together and, like counter reads, may
+ * miss values being recorded at that moment.
+ *
+ * Functions:
+ *     hist_create     - allocate an empty histogram.
+ *     hist_destroy    - free it.
+ *     hist_record     - record one value (nanoseconds, usually).
+ *     hist_merge      - add everything recorded in SRC to DST.
+ *     hist_reset      - empty it.
+ *     hist_count      - number of values recorded.
+ *     hist_mean       - their mean.
+ *     hist_max        - the largest, exactly.
+ *     hist_percentile - the value PCT percent of the values are at or
+ *                       below, 0 <= PCT <= 100. This is the top of
+ *                       the bucket it falls in (but never more than
+ *                       hist_max), so it may be high by 1/HIST_SUB.
+ *     hist_print      - print a one-line summary:
+ *                       NAME count=N mean_ns=M p50_ns=A p90_ns=B
+ *                       p99_ns=C max_ns=D
+ *     hist_dump       - print the non-empty buckets, one per line.
+ *
+ * Histograms are created with one set of buckets per CPU present at
+ * the time, so create them after the CPUs have started.
+ */
+
+/* Sub-buckets per power of two, as a number of bits. */
+#define HIST_SUBBITS	3
+#define HIST_SUB	(1 << HIST_SUBBITS)
+
+/* Values of 2^HIST_MAXBITS ns (about 68 seconds) and up share a bucket. */
+#define HIST_MAXBITS	36
+
+#define HIST_NBUCKETS	(HIST_SUB * (HIST_MAXBITS - HIST_SUBBITS + 1))
+
+struct histogram;
+
+struct histogram *hist_create(const char *name);
+void hist_destroy(struct histogram *h);
+
+void hist_record(struct histogram *h, uint64_t value);
+void hist_merge(struct histogram *dst, struct histogram *src);
+void hist_reset(struct histogram *h);
+
+uint64_t hist_count(struct histogram *h);
+uint64_t hist_mean(struct histogram *h);
+uint64_t hist_max(struct histogram *h);
+uint64_t hist_percentile(struct histogram *h, unsigned pct);
+
+void hist_print(struct histogram *h);
+void hist_dump(struct histogram *h);
+
+#endif /* _HISTOGRAM_H_ */
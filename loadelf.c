@@ -59,6 +59,11 @@
 #include <addrspace.h>
 #include <vnode.h>
 #include <elf.h>
+#if OPT_A3
+#include <vm.h>
+#include <elfmap.h>
+#include <elfcache.h>
+#endif /* OPT_A3 */
 
 /*
  * Load a segment at virtual address VADDR. The segment in memory
@@ -145,28 +150,101 @@ load_segment(struct addrspace *as, struct vnode *v,
 	return result;
 }
 
+#if OPT_A3
+struct elfmap *
+elfmap_create(struct vnode *v)
+{
+	struct elfmap *em;
+
+	em = kmalloc(sizeof(*em));
+	if (em == NULL) {
+		return NULL;
+	}
+	VOP_INCREF(v);
+	em->em_vnode = v;
+	em->em_entry = 0;
+	em->em_nsegs = 0;
+	spinlock_init(&em->em_lock);
+	em->em_refcount = 1;
+	return em;
+}
+
 /*
- * Load an ELF executable user program into the current address space.
- *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * Record a segment. load_segment's uiomove would also catch a
+ * segment outside user space, but checking here keeps a bad
+ * executable from ever getting into the exec cache.
  */
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+elfmap_addseg(struct elfmap *em, off_t offset, vaddr_t vaddr,
+	      size_t memsize, size_t filesize, uint32_t flags)
 {
-	Elf_Ehdr eh;   /* Executable header */
-	Elf_Phdr ph;   /* "Program header" = segment header */
-	int result, i;
-	struct iovec iov;
-	struct uio ku;
-	struct addrspace *as;
+	struct elfseg *es;
 
-	as = curproc_getas();
+	if (filesize > memsize) {
+		kprintf("ELF: warning: segment filesize > segment memsize\n");
+		filesize = memsize;
+	}
+	if (vaddr + memsize < vaddr || vaddr + memsize > USERSPACETOP) {
+		return ENOEXEC;
+	}
+	if (em->em_nsegs >= ELFMAP_MAXSEGS) {
+		kprintf("ELF: too many segments\n");
+		return ENOEXEC;
+	}
 
-	/*
-	 * Read the executable header from offset 0 in the file.
-	 */
+	DEBUG(DB_EXEC, "ELF: Mapping %lu bytes at 0x%lx\n",
+	      (unsigned long) filesize, (unsigned long) vaddr);
+
+	es = &em->em_segs[em->em_nsegs++];
+	es->es_vaddr = vaddr;
+	es->es_memsize = memsize;
+	es->es_filesize = filesize;
+	es->es_offset = offset;
+	es->es_flags = flags;
+	return 0;
+}
+
+void
+elfmap_incref(struct elfmap *em)
+{
+	spinlock_acquire(&em->em_lock);
+	em->em_refcount++;
+	spinlock_release(&em->em_lock);
+}
+
+void
+elfmap_decref(struct elfmap *em)
+{
+	unsigned count;
+
+	spinlock_acquire(&em->em_lock);
+	KASSERT(em->em_refcount > 0);
+	count = --em->em_refcount;
+	spinlock_release(&em->em_lock);
+
+	if (count > 0) {
+		return;
+	}
+
+	VOP_DECREF(em->em_vnode);
+	spinlock_cleanup(&em->em_lock);
+	kfree(em);
+}
+#endif /* OPT_A3 */
+
+/*
+ * Read the executable header from offset 0 in the file and make sure
+ * it is something we can run.
+ */
+static
+int
+load_ehdr(struct vnode *v, Elf_Ehdr *eh)
+{
+	struct iovec iov;
+	struct uio ku;
+	int result;
 
-	uio_kinit(&iov, &ku, &eh, sizeof(eh), 0, UIO_READ);
+	uio_kinit(&iov, &ku, eh, sizeof(*eh), 0, UIO_READ);
 	result = VOP_READ(v, &ku);
 	if (result) {
 		return result;
@@ -189,72 +267,214 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * which were not in the original elf spec.)
 	 */
 
-	if (eh.e_ident[EI_MAG0] != ELFMAG0 ||
-	    eh.e_ident[EI_MAG1] != ELFMAG1 ||
-	    eh.e_ident[EI_MAG2] != ELFMAG2 ||
-	    eh.e_ident[EI_MAG3] != ELFMAG3 ||
-	    eh.e_ident[EI_CLASS] != ELFCLASS32 ||
-	    eh.e_ident[EI_DATA] != ELFDATA2MSB ||
-	    eh.e_ident[EI_VERSION] != EV_CURRENT ||
-	    eh.e_version != EV_CURRENT ||
-	    eh.e_type!=ET_EXEC ||
-	    eh.e_machine!=EM_MACHINE) {
+	if (eh->e_ident[EI_MAG0] != ELFMAG0 ||
+	    eh->e_ident[EI_MAG1] != ELFMAG1 ||
+	    eh->e_ident[EI_MAG2] != ELFMAG2 ||
+	    eh->e_ident[EI_MAG3] != ELFMAG3 ||
+	    eh->e_ident[EI_CLASS] != ELFCLASS32 ||
+	    eh->e_ident[EI_DATA] != ELFDATA2MSB ||
+	    eh->e_ident[EI_VERSION] != EV_CURRENT ||
+	    eh->e_version != EV_CURRENT ||
+	    eh->e_type!=ET_EXEC ||
+	    eh->e_machine!=EM_MACHINE) {
 		return ENOEXEC;
 	}
 
-	/*
-	 * Go through the list of segments and set up the address space.
-	 *
-	 * Ordinarily there will be one code segment, one read-only
-	 * data segment, and one data/bss segment, but there might
-	 * conceivably be more. You don't need to support such files
-	 * if it's unduly awkward to do so.
-	 *
-	 * Note that the expression eh.e_phoff + i*eh.e_phentsize is 
-	 * mandated by the ELF standard - we use sizeof(ph) to load,
-	 * because that's the structure we know, but the file on disk
-	 * might have a larger structure, so we must use e_phentsize
-	 * to find where the phdr starts.
-	 */
+	return 0;
+}
 
-	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
+/*
+ * Upper bound on the size of the program header table. Real
+ * executables have a handful of entries; this just keeps a corrupt
+ * header from making us allocate something huge.
+ */
+#define ELF_MAXPHTABLE	65536
 
-		result = VOP_READ(v, &ku);
-		if (result) {
-			return result;
-		}
+/*
+ * Read the whole program header table of the executable described by
+ * EH in one I/O, and check every entry. On success *RET is a kmalloc'd
+ * copy of the table that the caller must free; entry I starts at byte
+ * I*e_phentsize.
+ *
+ * Note that the expression eh.e_phoff + i*eh.e_phentsize is mandated
+ * by the ELF standard - we use sizeof(ph) to look at each entry,
+ * because that's the structure we know, but the file on disk might
+ * have a larger structure, so we must use e_phentsize to find where
+ * each phdr starts.
+ */
+static
+int
+load_phdrs(struct vnode *v, const Elf_Ehdr *eh, char **ret)
+{
+	Elf_Phdr ph;
+	struct iovec iov;
+	struct uio ku;
+	size_t size;
+	char *table;
+	int result, i;
 
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
-		}
+	if (eh->e_phentsize < sizeof(ph)) {
+		kprintf("ELF: program header entries too small\n");
+		return ENOEXEC;
+	}
+	size = (size_t)eh->e_phnum * eh->e_phentsize;
+	if (size > ELF_MAXPHTABLE) {
+		kprintf("ELF: program header table too large\n");
+		return ENOEXEC;
+	}
+	if (size == 0) {
+		/* nothing to load; still hand back something to free */
+		size = 1;
+	}
+
+	table = kmalloc(size);
+	if (table == NULL) {
+		return ENOMEM;
+	}
 
+	uio_kinit(&iov, &ku, table, (size_t)eh->e_phnum * eh->e_phentsize,
+		  eh->e_phoff, UIO_READ);
+	result = VOP_READ(v, &ku);
+	if (result) {
+		kfree(table);
+		return result;
+	}
+
+	if (ku.uio_resid != 0) {
+		/* short read; problem with executable? */
+		kprintf("ELF: short read on phdr - file truncated?\n");
+		kfree(table);
+		return ENOEXEC;
+	}
+
+	for (i=0; i<eh->e_phnum; i++) {
+		memcpy(&ph, table + i*eh->e_phentsize, sizeof(ph));
 		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
+		    case PT_NULL:
+		    case PT_PHDR:
+		    case PT_MIPS_REGINFO:
+		    case PT_LOAD:
+			break;
 		    default:
 			kprintf("loadelf: unknown segment type %d\n", 
 				ph.p_type);
+			kfree(table);
 			return ENOEXEC;
 		}
+	}
+
+	*ret = table;
+	return 0;
+}
 
+/*
+ * Fetch program header I from TABLE into PH. Returns false for the
+ * entries we skip. The table has already been checked, so anything
+ * that is not skipped is PT_LOAD.
+ */
+static
+bool
+get_phdr(const Elf_Ehdr *eh, const char *table, int i, Elf_Phdr *ph)
+{
+	/* the entries need not be aligned in the buffer */
+	memcpy(ph, table + i*eh->e_phentsize, sizeof(*ph));
+	return ph->p_type == PT_LOAD;
+}
+
+#if OPT_A3
+/*
+ * Parse the executable V into a new elfmap: read and check its
+ * headers and record where each segment is. The exec cache calls
+ * this on a miss.
+ */
+int
+load_elfmap(struct vnode *v, struct elfmap **ret)
+{
+	Elf_Ehdr eh;
+	Elf_Phdr ph;
+	char *phtable;
+	struct elfmap *em;
+	int result, i;
+
+	result = load_ehdr(v, &eh);
+	if (result) {
+		return result;
+	}
+
+	result = load_phdrs(v, &eh, &phtable);
+	if (result) {
+		return result;
+	}
+
+	em = elfmap_create(v);
+	if (em == NULL) {
+		kfree(phtable);
+		return ENOMEM;
+	}
+	em->em_entry = eh.e_entry;
+
+	for (i=0; i<eh.e_phnum; i++) {
+		if (!get_phdr(&eh, phtable, i, &ph)) {
+			continue;
+		}
+		result = elfmap_addseg(em, ph.p_offset, ph.p_vaddr,
+				       ph.p_memsz, ph.p_filesz, ph.p_flags);
+		if (result) {
+			elfmap_decref(em);
+			kfree(phtable);
+			return result;
+		}
+	}
+
+	kfree(phtable);
+	*ret = em;
+	return 0;
+}
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ *
+ * The parsed executable comes from the exec cache, so running the
+ * same program again does not read its headers again.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct elfmap *em;
+	struct elfseg *es;
+	struct addrspace *as;
+	unsigned i;
+	int result;
+
+	as = curproc_getas();
+
+	result = elfcache_get(v, &em);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * Go through the list of segments and set up the address space.
+	 */
+
+	for (i=0; i<em->em_nsegs; i++) {
+		es = &em->em_segs[i];
 		result = as_define_region(as,
-					  ph.p_vaddr, ph.p_memsz,
-					  ph.p_flags & PF_R,
-					  ph.p_flags & PF_W,
-					  ph.p_flags & PF_X);
+					  es->es_vaddr, es->es_memsize,
+					  es->es_flags & PF_R,
+					  es->es_flags & PF_W,
+					  es->es_flags & PF_X);
 		if (result) {
+			elfmap_decref(em);
 			return result;
 		}
 	}
 
 	result = as_prepare_load(as);
 	if (result) {
+		elfmap_decref(em);
 		return result;
 	}
 
@@ -262,40 +482,104 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * Now actually load each segment.
 	 */
 
+	for (i=0; i<em->em_nsegs; i++) {
+		es = &em->em_segs[i];
+		result = load_segment(as, v, es->es_offset, es->es_vaddr,
+				      es->es_memsize, es->es_filesize,
+				      es->es_flags & PF_X);
+		if (result) {
+			elfmap_decref(em);
+			return result;
+		}
+	}
+
+	*entrypoint = em->em_entry;
+	elfmap_decref(em);
+
+	return as_complete_load(as);
+}
+#else
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	Elf_Ehdr eh;   /* Executable header */
+	Elf_Phdr ph;   /* "Program header" = segment header */
+	char *phtable; /* all of the program headers */
+	int result, i;
+	struct addrspace *as;
+
+	as = curproc_getas();
+
+	result = load_ehdr(v, &eh);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * Read and check all the program headers at once; both passes
+	 * below work from this copy.
+	 */
+	result = load_phdrs(v, &eh, &phtable);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * Go through the list of segments and set up the address space.
+	 *
+	 * Ordinarily there will be one code segment, one read-only
+	 * data segment, and one data/bss segment, but there might
+	 * conceivably be more. You don't need to support such files
+	 * if it's unduly awkward to do so.
+	 */
+
 	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
+		if (!get_phdr(&eh, phtable, i, &ph)) {
+			continue;
+		}
 
-		result = VOP_READ(v, &ku);
+		result = as_define_region(as,
+					  ph.p_vaddr, ph.p_memsz,
+					  ph.p_flags & PF_R,
+					  ph.p_flags & PF_W,
+					  ph.p_flags & PF_X);
 		if (result) {
+			kfree(phtable);
 			return result;
 		}
+	}
 
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
-		}
+	result = as_prepare_load(as);
+	if (result) {
+		kfree(phtable);
+		return result;
+	}
 
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n", 
-				ph.p_type);
-			return ENOEXEC;
+	/*
+	 * Now actually load each segment.
+	 */
+
+	for (i=0; i<eh.e_phnum; i++) {
+		if (!get_phdr(&eh, phtable, i, &ph)) {
+			continue;
 		}
 
 		result = load_segment(as, v, ph.p_offset, ph.p_vaddr, 
 				      ph.p_memsz, ph.p_filesz,
 				      ph.p_flags & PF_X);
 		if (result) {
+			kfree(phtable);
 			return result;
 		}
 	}
 
+	kfree(phtable);
+
 	result = as_complete_load(as);
 	if (result) {
 		return result;
@@ -305,3 +589,4 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 
 	return 0;
 }
+#endif /* OPT_A3 */
@@ -49,6 +49,16 @@
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
+#include <conbuf.h>
+#include <boottask.h>
+#include <bootprof.h>
+#if OPT_A3
+#include <elfcache.h>
+#endif /* OPT_A3 */
+#if OPT_A2
+#include <pid.h>
+#include <asreaper.h>
+#endif /* OPT_A2 */
 #include "autoconf.h"  // for pseudoconfig
 
 
@@ -72,6 +82,16 @@ static const char harvard_copyright[] =
     "   President and Fellows of Harvard College.  All rights reserved.\n";
 
 
+/*
+ * Default bootfs - but ignore failure, in case emu0 doesn't exist.
+ */
+static
+void
+boot_bootfs(void)
+{
+	vfs_setbootfs("emu0");
+}
+
 /*
  * Initial boot sequence.
  */
@@ -106,35 +126,67 @@ boot(void)
 	kprintf("\n");
 
 	/* Early initialization. */
+	bootprof_phase("ram_bootstrap");
 	ram_bootstrap();
 #if OPT_A3
+	bootprof_phase("vm_bootstrap");
     vm_bootstrap();
 #endif /* OPT_A3 */
+#if OPT_A2
+	bootprof_phase("pid_bootstrap");
+	pid_bootstrap();
+#endif /* OPT_A2 */
+	bootprof_phase("proc_bootstrap");
 	proc_bootstrap();
+	bootprof_phase("thread_bootstrap");
 	thread_bootstrap();
+	bootprof_phase("hardclock_bootstrap");
 	hardclock_bootstrap();
+	bootprof_phase("vfs_bootstrap");
 	vfs_bootstrap();
 
 	/* Probe and initialize devices. Interrupts should come on. */
 	kprintf("Device probe...\n");
 	KASSERT(curthread->t_curspl > 0);
+	bootprof_phase("mainbus_bootstrap");
 	mainbus_bootstrap();
+	bootprof_clockready();
 	KASSERT(curthread->t_curspl == 0);
-	/* Now do pseudo-devices. */
-	pseudoconfig();
 	kprintf("\n");
 
 	/* Late phase of initialization. */
 #if OPT_A3
 #else
+	bootprof_phase("vm_bootstrap");
 	vm_bootstrap();
 #endif /* OPT_A3 */
+	bootprof_phase("kprintf_bootstrap");
 	kprintf_bootstrap();
-	thread_start_cpus();
 
-	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
-	vfs_setbootfs("emu0");
+	/*
+	 * The rest is independent setup that the secondary CPUs can
+	 * help with; see boottask.h. Pseudo-devices and the bootfs
+	 * go in here too.
+	 */
+	boottask_bootstrap();
+	boottask_add("pseudoconfig", pseudoconfig, 0);
+#if OPT_A3
+	boottask_add("elfcache", elfcache_bootstrap, 0);
+#endif /* OPT_A3 */
+	boottask_add("conbuf", conbuf_bootstrap, 0);
+#if OPT_A2
+	boottask_add("asreaper", asreaper_bootstrap, 0);
+#endif /* OPT_A2 */
+	boottask_add("vfs_setbootfs", boot_bootfs, 0);
 
+	bootprof_phase("thread_start_cpus");
+	thread_start_cpus();
+	bootprof_phase("boot tasks");
+	boottask_run();
+	bootprof_done();
+
+	boottask_print();
+	bootprof_print();
 
 	/*
 	 * Make sure various things aren't screwed up.
@@ -152,6 +204,17 @@ shutdown(void)
 {
 
 	kprintf("Shutting down.\n");
+
+	/* let any buffered user console output reach the device */
+	conbuf_flush();
+#if OPT_A2
+	/* dead address spaces may still hold executables open */
+	asreaper_flush();
+#endif /* OPT_A2 */
+#if OPT_A3
+	/* cached executables hold their vnodes open */
+	elfcache_flush();
+#endif /* OPT_A3 */
 	
 	vfs_clearbootfs();
 	vfs_clearcurdir();
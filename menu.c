@@ -42,6 +42,18 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <counter.h>
+#include <cpu.h>
+#include <cpus.h>
+#include <current.h>
+#include <smpcall.h>
+#include <boottask.h>
+#include <bootprof.h>
+#include <histogram.h>
+#include <bench.h>
+#if OPT_A2
+#include <pid.h>
+#endif /* OPT_A2 */
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -54,6 +66,16 @@
 
 #define MAXMENUARGS  16
 
+#if OPT_A2
+/*
+ * Programs started from the menu are children of this pid, so that
+ * each can be waited for on its own even when several run at once
+ * (see "bg" below). No process has it; it is allocated once, in
+ * menu(), and never exits.
+ */
+static pid_t menu_pid;
+#endif /* OPT_A2 */
+
 // XXX this should not be in this file
 void
 getinterval(time_t s1, uint32_t ns1, time_t s2, uint32_t ns2,
@@ -111,6 +133,10 @@ cmd_progthread(void *ptr, unsigned long nargs)
 	if (result) {
 		kprintf("Running program %s failed: %s\n", args[0],
 			strerror(result));
+#if OPT_A2
+		/* let common_prog stop waiting for us */
+		pid_exit(curproc->pid, 1);
+#endif /* OPT_A2 */
 		return;
 	}
 
@@ -120,14 +146,16 @@ cmd_progthread(void *ptr, unsigned long nargs)
 /*
  * Common code for cmd_prog and cmd_shell.
  *
- * Note that this does not wait for the subprogram to finish, but
- * returns immediately to the menu. This is usually not what you want,
- * so you should have it call your system-calls-assignment waitpid
- * code after forking.
+ * This waits for the program to exit before returning, which also
+ * keeps the "args" array and strings alive as long as the program's
+ * thread is using them. With OPT_A2 it waits for that program alone,
+ * through its pid, so several menu commands (background jobs) can
+ * each run a program at once; otherwise, under UW, it waits until
+ * no processes are left at all.
  *
- * Also note that because the subprogram's thread uses the "args"
- * array and strings, until you do this a race condition exists
- * between that code and the menu input code.
+ * With OPT_A2 a program that exits with a nonzero code, or cannot be
+ * started at all, counts as a failed command, so "repeat" stops and
+ * "bg" reports it.
  */
 static
 int
@@ -135,6 +163,10 @@ common_prog(int nargs, char **args)
 {
 	struct proc *proc;
 	int result;
+#if OPT_A2
+	pid_t pid;
+	int exitcode;
+#endif /* OPT_A2 */
 
 #if OPT_SYNCHPROBS
 	kprintf("Warning: this probably won't work with a "
@@ -146,6 +178,16 @@ common_prog(int nargs, char **args)
 	if (proc == NULL) {
 		return ENOMEM;
 	}
+#if OPT_A2
+	/* the menu collects the program's exit code below */
+	result = pid_alloc(menu_pid, &proc->pid);
+	if (result) {
+		proc_destroy(proc);
+		return result;
+	}
+	/* proc may be gone by the time we wait */
+	pid = proc->pid;
+#endif /* OPT_A2 */
 
 	result = thread_fork(args[0] /* thread name */,
 			proc /* new process */,
@@ -153,11 +195,24 @@ common_prog(int nargs, char **args)
 			args /* thread arg */, nargs /* thread arg */);
 	if (result) {
 		kprintf("thread_fork failed: %s\n", strerror(result));
+#if OPT_A2
+		pid_unalloc(proc->pid);
+#endif /* OPT_A2 */
 		proc_destroy(proc);
 		return result;
 	}
 
-#ifdef UW
+#if OPT_A2
+	/* wait until the process we have just launched is finished
+	   before proceeding; it flushes its own console output first */
+	result = pid_wait(menu_pid, pid, 0, &pid, &exitcode);
+	KASSERT(result == 0);
+	if (exitcode != 0) {
+		kprintf("Program %s exited with code %d\n", args[0],
+			exitcode);
+		return EIO;
+	}
+#elif defined(UW)
 	/* wait until the process we have just launched - and any others that it 
 	   may fork - is finished before proceeding */
 	P(no_proc_sem);
@@ -203,6 +258,84 @@ cmd_shell(int nargs, char **args)
 	return common_prog(nargs, args);
 }
 
+/*
+ * Command for timing menu-launched programs with many arguments.
+ * Runs PROGRAM ITERATIONS times, each time with NARGS generated
+ * arguments after its name, and prints the mean time per launch.
+ * This is mostly the cost of staging the arguments (see argpack.h)
+ * plus starting and running the program, so use one that exits
+ * promptly.
+ */
+#define ARGBENCH_MAXARGS	1024
+#define ARGBENCH_ARGLEN		16
+
+static
+int
+cmd_argbench(int nargs, char **args)
+{
+	char **pargs;
+	char *strs;
+	int n, iters, i, result;
+	time_t s1, s2, secs;
+	uint32_t ns1, ns2, nsecs;
+	uint64_t ns;
+
+	if (nargs < 3 || nargs > 4) {
+		kprintf("Usage: apb program nargs [iterations]\n");
+		return EINVAL;
+	}
+	n = atoi(args[2]);
+	iters = nargs == 4 ? atoi(args[3]) : 10;
+	if (n < 0 || n > ARGBENCH_MAXARGS || iters <= 0) {
+		kprintf("apb: nargs must be 0-%d and iterations positive\n",
+			ARGBENCH_MAXARGS);
+		return EINVAL;
+	}
+
+#if !OPT_A2 && !defined(UW)
+	/* common_prog only waits for the program under OPT_A2 or UW */
+	kprintf("apb: needs a kernel that waits for menu programs\n");
+	return ENOSYS;
+#endif
+
+	pargs = kmalloc((n + 2) * sizeof(char *));
+	strs = kmalloc(n * ARGBENCH_ARGLEN + 1);
+	if (pargs == NULL || strs == NULL) {
+		kfree(pargs);
+		kfree(strs);
+		return ENOMEM;
+	}
+	pargs[0] = args[1];
+	for (i=0; i<n; i++) {
+		snprintf(strs + i * ARGBENCH_ARGLEN, ARGBENCH_ARGLEN,
+			 "arg%d", i);
+		pargs[i + 1] = strs + i * ARGBENCH_ARGLEN;
+	}
+	pargs[n + 1] = NULL;
+
+	result = 0;
+	gettime(&s1, &ns1);
+	for (i=0; i<iters && result == 0; i++) {
+		result = common_prog(n + 1, pargs);
+	}
+	gettime(&s2, &ns2);
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+
+	kfree(pargs);
+	kfree(strs);
+	if (result) {
+		kprintf("apb: %s: %s\n", args[1], strerror(result));
+		return result;
+	}
+
+	ns = (uint64_t)secs * 1000000000 + nsecs;
+	kprintf("argbench program=%s nargs=%d iters=%d time=%lu.%09lu "
+		"ns_per_launch=%llu\n", args[1], n, iters,
+		(unsigned long)secs, (unsigned long)nsecs,
+		(unsigned long long)(ns / iters));
+	return 0;
+}
+
 /*
  * Command for changing directory.
  */
@@ -415,6 +548,433 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for printing (and optionally resetting) kernel statistics.
+ */
+static
+int
+cmd_kstats(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		kstat_reset();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: ks [reset]\n");
+		return EINVAL;
+	}
+
+	kstat_print();
+
+	return 0;
+}
+
+/*
+ * Command for listing CPUs and taking them offline or online.
+ */
+static
+int
+cmd_cpu(int nargs, char **args)
+{
+	struct cpu *c;
+	unsigned i, n;
+	int result;
+
+	if (nargs == 1) {
+		for (i=0; i<cpus_count(); i++) {
+			c = cpus_get(i);
+			kprintf("cpu%u: %s\n", c->c_number,
+				cpus_isonline(c) ? "online" : "offline");
+		}
+		return 0;
+	}
+	if (nargs != 3 || (strcmp(args[1], "off") && strcmp(args[1], "on"))) {
+		kprintf("Usage: cpu [off|on cpunum]\n");
+		return EINVAL;
+	}
+	n = atoi(args[2]);
+	if (n >= cpus_count()) {
+		kprintf("cpu: no cpu%u\n", n);
+		return EINVAL;
+	}
+
+	c = cpus_get(n);
+	if (!strcmp(args[1], "off")) {
+		result = cpus_offline(c);
+	}
+	else {
+		result = cpus_online(c);
+	}
+	if (result) {
+		kprintf("cpu %s %u: %s\n", args[1], n, strerror(result));
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Cross-CPU call test. Makes a synchronous call to each online CPU in
+ * turn, then starts an asynchronous call to every online CPU at once
+ * and waits for them all, checking that each call ran on the CPU it
+ * was sent to.
+ */
+static
+void
+smpcalltest_func(void *data)
+{
+	unsigned *ranon = data;
+
+	*ranon = curcpu->c_number;
+}
+
+static
+int
+cmd_smpcalltest(int nargs, char **args)
+{
+	struct smpcall *calls;
+	unsigned *ranon;
+	struct cpu *c;
+	unsigned i, n, ncalls, bad;
+
+	(void)nargs;
+	(void)args;
+
+	n = cpus_count();
+	calls = kmalloc(n * sizeof(calls[0]));
+	ranon = kmalloc(n * sizeof(ranon[0]));
+	if (calls == NULL || ranon == NULL) {
+		kfree(calls);
+		kfree(ranon);
+		return ENOMEM;
+	}
+
+	kprintf("Starting cross-CPU call test...\n");
+	ncalls = bad = 0;
+
+	for (i=0; i<n; i++) {
+		c = cpus_get(i);
+		if (!cpus_isonline(c)) {
+			continue;
+		}
+		ranon[i] = n;
+		smp_call(c, smpcalltest_func, &ranon[i]);
+		if (ranon[i] != c->c_number) {
+			kprintf("smp_call to cpu%u ran on cpu%u\n",
+				c->c_number, ranon[i]);
+			bad++;
+		}
+		ncalls++;
+	}
+
+	/* N+1 marks CPUs that were offline, so nothing was sent */
+	for (i=0; i<n; i++) {
+		c = cpus_get(i);
+		if (!cpus_isonline(c)) {
+			ranon[i] = n + 1;
+			continue;
+		}
+		ranon[i] = n;
+		smp_call_async(c, &calls[i], smpcalltest_func, &ranon[i]);
+	}
+	for (i=0; i<n; i++) {
+		if (ranon[i] == n + 1) {
+			continue;
+		}
+		smp_call_wait(&calls[i]);
+		KASSERT(smp_call_done(&calls[i]));
+		if (ranon[i] != i) {
+			kprintf("smp_call_async to cpu%u ran on cpu%u\n",
+				i, ranon[i]);
+			bad++;
+		}
+		ncalls++;
+	}
+
+	kfree(calls);
+	kfree(ranon);
+
+	if (bad > 0) {
+		kprintf("Cross-CPU call test failed: %u of %u calls "
+			"went astray\n", bad, ncalls);
+		return EIO;
+	}
+	kprintf("Cross-CPU call test done: %u calls\n", ncalls);
+	return 0;
+}
+
+/*
+ * Command for printing the boot profile.
+ */
+static
+int
+cmd_bootprof(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	boottask_print();
+	bootprof_print();
+	return 0;
+}
+
+////////////////////////////////////////
+//
+// Scripting: repeating commands and running them in the background.
+
+static int cmd_run(int nargs, char **args, uint64_t *ns);
+
+/*
+ * A command started with "bg". The job owns copies of its words, so
+ * the line it came from can be reused while it runs.
+ */
+struct menujob {
+	unsigned mj_num;		/* job number, for messages */
+	char *mj_line;			/* the command, for messages */
+	char *mj_words;			/* mj_line again, split up */
+	int mj_nargs;
+	char *mj_args[MAXMENUARGS];
+	struct menujob *mj_next;
+};
+
+static struct lock *menujob_lock;	/* protects the rest */
+static struct cv *menujob_cv;		/* signalled when a job finishes */
+static struct menujob *menujobs;	/* running jobs */
+static unsigned menujob_next;		/* next job number */
+
+/*
+ * Join NARGS words into one string, with single spaces.
+ */
+static
+char *
+menu_joinwords(int nargs, char **args)
+{
+	size_t len;
+	char *line;
+	int i;
+
+	len = 0;
+	for (i=0; i<nargs; i++) {
+		len += strlen(args[i]) + 1;
+	}
+	line = kmalloc(len);
+	if (line == NULL) {
+		return NULL;
+	}
+	line[0] = '\0';
+	for (i=0; i<nargs; i++) {
+		if (i > 0) {
+			strcat(line, " ");
+		}
+		strcat(line, args[i]);
+	}
+	return line;
+}
+
+/*
+ * Take JOB off the list of running jobs and wake anyone joining.
+ */
+static
+void
+menujob_remove(struct menujob *job)
+{
+	struct menujob **jj;
+
+	lock_acquire(menujob_lock);
+	for (jj = &menujobs; *jj != job; jj = &(*jj)->mj_next) {
+		KASSERT(*jj != NULL);
+	}
+	*jj = job->mj_next;
+	cv_broadcast(menujob_cv, menujob_lock);
+	lock_release(menujob_lock);
+}
+
+static
+void
+menujob_destroy(struct menujob *job)
+{
+	kfree(job->mj_words);
+	kfree(job->mj_line);
+	kfree(job);
+}
+
+static
+void
+menujob_thread(void *ptr, unsigned long unused)
+{
+	struct menujob *job = ptr;
+	uint64_t ns;
+	int result;
+
+	(void)unused;
+
+	result = cmd_run(job->mj_nargs, job->mj_args, &ns);
+	kprintf("[%u] %s (%s) took %lu.%09lu seconds\n", job->mj_num,
+		result ? strerror(result) : "Done", job->mj_line,
+		(unsigned long)(ns / 1000000000),
+		(unsigned long)(ns % 1000000000));
+
+	menujob_remove(job);
+	menujob_destroy(job);
+}
+
+/*
+ * Command for running a command in the background. Prints the job
+ * number and returns at once; the job prints its result and wall
+ * time when it finishes. Only "p" and "s" are allowed: each program
+ * gets its own process, so they are safe to run alongside
+ * themselves, but most of the tests and benchmarks use global state.
+ */
+static
+int
+cmd_bg(int nargs, char **args)
+{
+	struct menujob *job;
+	char *word, *context;
+	int result;
+
+	if (nargs < 2) {
+		kprintf("Usage: bg command [args]\n");
+		return EINVAL;
+	}
+	if (strcmp(args[1], "p") && strcmp(args[1], "s")) {
+		kprintf("bg: only p and s can run in the background\n");
+		return EINVAL;
+	}
+
+	job = kmalloc(sizeof(*job));
+	if (job == NULL) {
+		return ENOMEM;
+	}
+	job->mj_line = menu_joinwords(nargs - 1, args + 1);
+	job->mj_words = menu_joinwords(nargs - 1, args + 1);
+	if (job->mj_line == NULL || job->mj_words == NULL) {
+		kfree(job->mj_line);
+		kfree(job->mj_words);
+		kfree(job);
+		return ENOMEM;
+	}
+	job->mj_nargs = 0;
+	for (word = strtok_r(job->mj_words, " ", &context);
+	     word != NULL;
+	     word = strtok_r(NULL, " ", &context)) {
+		job->mj_args[job->mj_nargs++] = word;
+	}
+
+	lock_acquire(menujob_lock);
+	job->mj_num = ++menujob_next;
+	job->mj_next = menujobs;
+	menujobs = job;
+	lock_release(menujob_lock);
+
+	kprintf("[%u] %s\n", job->mj_num, job->mj_line);
+
+	result = thread_fork("menu job", NULL, menujob_thread, job, 0);
+	if (result) {
+		menujob_remove(job);
+		menujob_destroy(job);
+		return result;
+	}
+	return 0;
+}
+
+/*
+ * Command for waiting until all background jobs have finished. Its
+ * own wall time is then the time until the last one finished.
+ */
+static
+int
+cmd_join(int nargs, char **args)
+{
+	(void)args;
+
+	if (nargs != 1) {
+		kprintf("Usage: join\n");
+		return EINVAL;
+	}
+
+	lock_acquire(menujob_lock);
+	while (menujobs != NULL) {
+		cv_wait(menujob_cv, menujob_lock);
+	}
+	lock_release(menujob_lock);
+	return 0;
+}
+
+/*
+ * Command for listing background jobs.
+ */
+static
+int
+cmd_jobs(int nargs, char **args)
+{
+	struct menujob *job;
+
+	(void)args;
+
+	if (nargs != 1) {
+		kprintf("Usage: jobs\n");
+		return EINVAL;
+	}
+
+	lock_acquire(menujob_lock);
+	for (job = menujobs; job != NULL; job = job->mj_next) {
+		kprintf("[%u] Running (%s)\n", job->mj_num, job->mj_line);
+	}
+	lock_release(menujob_lock);
+	return 0;
+}
+
+/*
+ * Command for running a command N times in a row. Each run's wall
+ * time goes into a histogram, printed at the end as one line:
+ *
+ *   repeat COMMAND count=N mean_ns=M p50_ns=A p90_ns=B p99_ns=C max_ns=D
+ *
+ * Stops at the first run that fails. "repeat 8 bg p prog" starts
+ * eight copies of prog at once; follow it with "join" to wait for
+ * them.
+ */
+static
+int
+cmd_repeat(int nargs, char **args)
+{
+	char *runargs[MAXMENUARGS];
+	struct histogram *h;
+	char *line, *name;
+	uint64_t ns;
+	int n, i, result;
+
+	n = nargs < 3 ? 0 : atoi(args[1]);
+	if (n <= 0) {
+		kprintf("Usage: repeat count command [args]\n");
+		return EINVAL;
+	}
+
+	line = menu_joinwords(nargs - 2, args + 2);
+	name = line == NULL ? NULL : kmalloc(strlen(line) + 8);
+	h = name == NULL ? NULL : hist_create(name);
+	if (h == NULL) {
+		kfree(name);
+		kfree(line);
+		return ENOMEM;
+	}
+	snprintf(name, strlen(line) + 8, "repeat %s", line);
+
+	result = 0;
+	for (i=0; i<n && result == 0; i++) {
+		/* commands may scribble on their argument array */
+		memcpy(runargs, args + 2, (nargs - 2) * sizeof(args[0]));
+		result = cmd_run(nargs - 2, runargs, &ns);
+		hist_record(h, ns);
+	}
+
+	hist_print(h);
+	hist_destroy(h);
+	kfree(name);
+	kfree(line);
+	return result;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -455,8 +1015,13 @@ static const char *opsmenu[] = {
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
 	"[panic]   Intentional panic         ",
+	"[cpu]     CPU status / off / on     ",
 	"[q]       Quit and shut down        ",
         "[dth]     Enable thread debug mesgs ",
+	"[repeat]  Run a command N times     ",
+	"[bg]      Run command in background ",
+	"[join]    Wait for background jobs  ",
+	"[jobs]    List background jobs      ",
 	NULL
 };
 
@@ -479,6 +1044,7 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[smp] Cross-CPU call test           ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -514,9 +1080,35 @@ cmd_testmenu(int n, char **a)
 	return 0;
 }
 
+static const char *benchmenu[] = {
+	"[bench] All microbenchmarks         ",
+	"[ypb] Yield ping-pong               ",
+	"[spb] Semaphore ping-pong           ",
+	"[lcb] Lock contention               ",
+	"[feb] Thread fork/exit              ",
+	"[kmb] kmalloc/kfree                 ",
+	"[csb] Clock sleep accuracy          ",
+	"[pcb] Per-CPU counter benchmark     ",
+	"[apb] Program argument benchmark    ",
+	"[swb] Context switch benchmark      ",
+	NULL
+};
+
+static
+int
+cmd_benchmenu(int n, char **a)
+{
+	(void)n;
+	(void)a;
+
+	showmenu("OS/161 benchmarks menu", benchmenu);
+	return 0;
+}
+
 static const char *mainmenu[] = {
 	"[?o] Operations menu                ",
 	"[?t] Tests menu                     ",
+	"[?b] Benchmarks menu                ",
 #if OPT_SYNCHPROBS
 	"[sp1] Whale Mating                  ",
 #ifdef UW
@@ -524,6 +1116,8 @@ static const char *mainmenu[] = {
 #endif /* UW */
 #endif
 	"[kh] Kernel heap stats              ",
+	"[ks] Kernel statistics              ",
+	"[bp] Boot profile                   ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -553,6 +1147,7 @@ static struct {
 	{ "help",	cmd_mainmenu },
 	{ "?o",		cmd_opsmenu },
 	{ "?t",		cmd_testmenu },
+	{ "?b",		cmd_benchmenu },
 
 	/* operations */
 	{ "s",		cmd_shell },
@@ -566,10 +1161,17 @@ static struct {
 	{ "sync",	cmd_sync },
 	{ "panic",	cmd_panic },
 	{ "q",		cmd_quit },
+	{ "cpu",	cmd_cpu },
 	{ "exit",	cmd_quit },
 	{ "halt",	cmd_quit },
         { "dth",        cmd_dth },
 
+	/* scripting */
+	{ "repeat",	cmd_repeat },
+	{ "bg",		cmd_bg },
+	{ "join",	cmd_join },
+	{ "jobs",	cmd_jobs },
+
 #if OPT_SYNCHPROBS
 	/* in-kernel synchronization problem(s) */
 	{ "sp1",	whalemating },
@@ -580,6 +1182,8 @@ static struct {
 
 	/* stats */
 	{ "kh",         cmd_kheapstats },
+	{ "ks",		cmd_kstats },
+	{ "bp",		cmd_bootprof },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -592,6 +1196,7 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "smp",	cmd_smpcalltest },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
@@ -609,38 +1214,34 @@ static struct {
 	{ "fs4",	writestress2 },
 	{ "fs5",	createstress },
 
+	/* benchmarks */
+	{ "pcb",	counterbench },
+	{ "apb",	cmd_argbench },
+	{ "swb",	switchbench },
+	{ "bench",	microbench },
+	{ "ypb",	yieldbench },
+	{ "spb",	sembench },
+	{ "lcb",	lockbench },
+	{ "feb",	forkexitbench },
+	{ "kmb",	mallocbench },
+	{ "csb",	clocksleepbench },
+
 	{ NULL, NULL }
 };
 
 /*
- * Process a single command.
+ * Run the command in ARGS and return its result, and its wall time
+ * in *NS.
  */
 static
 int
-cmd_dispatch(char *cmd)
+cmd_run(int nargs, char **args, uint64_t *ns)
 {
 	time_t beforesecs, aftersecs, secs;
 	uint32_t beforensecs, afternsecs, nsecs;
-	char *args[MAXMENUARGS];
-	int nargs=0;
-	char *word;
-	char *context;
 	int i, result;
 
-	for (word = strtok_r(cmd, " \t", &context);
-	     word != NULL;
-	     word = strtok_r(NULL, " \t", &context)) {
-
-		if (nargs >= MAXMENUARGS) {
-			kprintf("Command line has too many words\n");
-			return E2BIG;
-		}
-		args[nargs++] = word;
-	}
-
-	if (nargs==0) {
-		return 0;
-	}
+	KASSERT(nargs > 0);
 
 	for (i=0; cmdtable[i].name; i++) {
 		if (*cmdtable[i].name && !strcmp(args[0], cmdtable[i].name)) {
@@ -655,18 +1256,54 @@ cmd_dispatch(char *cmd)
 				    aftersecs, afternsecs,
 				    &secs, &nsecs);
 
-			kprintf("Operation took %lu.%09lu seconds\n",
-				(unsigned long) secs,
-				(unsigned long) nsecs);
-
+			*ns = (uint64_t)secs * 1000000000 + nsecs;
 			return result;
 		}
 	}
 
 	kprintf("%s: Command not found\n", args[0]);
+	*ns = 0;
 	return EINVAL;
 }
 
+/*
+ * Process a single command.
+ */
+static
+int
+cmd_dispatch(char *cmd)
+{
+	char *args[MAXMENUARGS];
+	int nargs=0;
+	char *word;
+	char *context;
+	uint64_t ns;
+	int result;
+
+	for (word = strtok_r(cmd, " \t", &context);
+	     word != NULL;
+	     word = strtok_r(NULL, " \t", &context)) {
+
+		if (nargs >= MAXMENUARGS) {
+			kprintf("Command line has too many words\n");
+			return E2BIG;
+		}
+		args[nargs++] = word;
+	}
+
+	if (nargs==0) {
+		return 0;
+	}
+
+	result = cmd_run(nargs, args, &ns);
+
+	kprintf("Operation took %lu.%09lu seconds\n",
+		(unsigned long)(ns / 1000000000),
+		(unsigned long)(ns % 1000000000));
+
+	return result;
+}
+
 /*
  * Evaluate a command line that may contain multiple semicolon-delimited
  * commands.
@@ -715,6 +1352,11 @@ menu_execute(char *line, int isargs)
  * the kernel command line
  *
  *      "mount sfs lhd0; bootfs lhd0; s"
+ *
+ * and to run eight copies of a program at once and time how long
+ * they take all together, one would use
+ *
+ *      "repeat 8 bg p /testbin/forkbench; join"
  */
 
 void
@@ -722,6 +1364,17 @@ menu(char *args)
 {
 	char buf[64];
 
+	menujob_lock = lock_create("menu jobs");
+	menujob_cv = cv_create("menu jobs");
+	if (menujob_lock == NULL || menujob_cv == NULL) {
+		panic("menu: out of memory\n");
+	}
+#if OPT_A2
+	if (pid_alloc(PID_NOPARENT, &menu_pid)) {
+		panic("menu: cannot allocate a pid\n");
+	}
+#endif /* OPT_A2 */
+
 	menu_execute(args, 1);
 
 	while (1) {
@@ -0,0 +1,698 @@
+/*
+ * Kernel microbenchmarks.
+ *
+ * A standard set of small benchmarks of the kernel's basic
+ * operations, all reporting in the same form so that runs can be
+ * compared and collected by scripts:
+ *
+ *   ypb - thread_yield between two threads on one CPU.
+ *   spb - semaphore ping-pong between threads on two CPUs.
+ *   lcb - several threads contending for one lock.
+ *   feb - thread_fork of a thread that exits at once, and the wait
+ *         for it to finish.
+ *   kmb - kmalloc and kfree of one block, for several sizes.
+ *   csb - clock_sleepns, for several lengths; the latencies reported
+ *         are how much each sleep overshot.
+ *
+ * "bench" runs them all with their default arguments.
+ *
+ * Every operation is timed on its own with gettime, and each run
+ * prints one line:
+ *
+ *   bench NAME threads=T ops=N time=S.NNNNNNNNN ops_per_sec=R
+ *       p50_ns=A p90_ns=B p99_ns=C max_ns=D
+ *
+ * (all on one line). time is the wall time of the whole run, from
+ * releasing the threads until the last one finishes; the percentiles
+ * are of the individual operations, collected in a histogram (see
+ * histogram.h), so they are within 12.5% of the exact value. Each
+ * latency includes the cost of reading the clock once, which is
+ * worth measuring on its own before reading too much into the
+ * smallest numbers.
+ *
+ * As with swb, ypb only measures yields if both threads stay on one
+ * CPU; with several CPUs the scheduler may move one of them to an
+ * idle CPU, after which each yield finds nothing else to run.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <cpu.h>
+#include <current.h>
+#include <thread.h>
+#include <synch.h>
+#include <cpus.h>
+#include <histogram.h>
+#include <bench.h>
+
+#define YPB_ITERS	5000
+#define SPB_ITERS	5000
+#define LCB_THREADS	4
+#define LCB_MAXTHREADS	64
+#define LCB_ITERS	2000
+#define FEB_ITERS	500
+#define KMB_ITERS	2000
+#define CSB_ITERS	20
+
+/* a point in time, as returned by gettime */
+struct mbstamp {
+	time_t ms_secs;
+	uint32_t ms_nsecs;
+};
+
+static struct semaphore *mb_start;	/* releases the threads together */
+static struct semaphore *mb_done;	/* threads signal when finished */
+static struct histogram *mb_hist;	/* per-operation latencies, ns */
+static unsigned long mb_iters;		/* operations per thread */
+
+////////////////////////////////////////////////////////////
+// Timing and reporting
+
+static
+void
+mb_stamp(struct mbstamp *st)
+{
+	gettime(&st->ms_secs, &st->ms_nsecs);
+}
+
+/*
+ * Nanoseconds since ST.
+ */
+static
+uint64_t
+mb_since(const struct mbstamp *st)
+{
+	time_t s, secs;
+	uint32_t ns, nsecs;
+
+	gettime(&s, &ns);
+	getinterval(st->ms_secs, st->ms_nsecs, s, ns, &secs, &nsecs);
+	return (uint64_t)secs * 1000000000 + nsecs;
+}
+
+/*
+ * Record one latency.
+ */
+static
+void
+mb_record(uint64_t ns)
+{
+	hist_record(mb_hist, ns);
+}
+
+/*
+ * Print the result line for a run of NOPS operations by NTHREADS
+ * threads that took TOTALNS, and empty the histogram for the next
+ * run.
+ */
+static
+void
+mb_report(const char *name, unsigned nthreads, unsigned long nops,
+	  uint64_t totalns)
+{
+	uint64_t rate;
+
+	KASSERT(hist_count(mb_hist) == nops);
+
+	rate = totalns == 0 ? 0 : (uint64_t)nops * 1000000000 / totalns;
+	kprintf("bench %s threads=%u ops=%lu time=%lu.%09lu ops_per_sec=%llu "
+		"p50_ns=%lu p90_ns=%lu p99_ns=%lu max_ns=%lu\n",
+		name, nthreads, nops,
+		(unsigned long)(totalns / 1000000000),
+		(unsigned long)(totalns % 1000000000),
+		(unsigned long long)rate,
+		(unsigned long)hist_percentile(mb_hist, 50),
+		(unsigned long)hist_percentile(mb_hist, 90),
+		(unsigned long)hist_percentile(mb_hist, 99),
+		(unsigned long)hist_max(mb_hist));
+	hist_reset(mb_hist);
+}
+
+static
+int
+mb_setup(void)
+{
+	mb_start = sem_create("microbench start", 0);
+	mb_done = sem_create("microbench done", 0);
+	mb_hist = hist_create("microbench");
+	if (mb_start == NULL || mb_done == NULL || mb_hist == NULL) {
+		if (mb_hist != NULL) {
+			hist_destroy(mb_hist);
+		}
+		if (mb_done != NULL) {
+			sem_destroy(mb_done);
+		}
+		if (mb_start != NULL) {
+			sem_destroy(mb_start);
+		}
+		mb_hist = NULL;
+		mb_done = NULL;
+		mb_start = NULL;
+		return ENOMEM;
+	}
+	return 0;
+}
+
+static
+void
+mb_cleanup(void)
+{
+	hist_destroy(mb_hist);
+	sem_destroy(mb_done);
+	sem_destroy(mb_start);
+	mb_hist = NULL;
+	mb_done = NULL;
+	mb_start = NULL;
+}
+
+/*
+ * Start FUNC in NTHREADS threads, thread I on CPU CPUS[I] (or the
+ * current CPU, if CPUS is NULL) with I as its argument; release them
+ * all at once and wait for them to finish. Returns the wall time in
+ * *NS.
+ *
+ * If a thread cannot be started, the ones that were are released
+ * with mb_iters set to 0, so they finish without doing anything, and
+ * the error is returned once they have.
+ */
+static
+int
+mb_runthreads(const char *name, unsigned nthreads, struct cpu **cpus,
+	      void (*func)(void *, unsigned long), uint64_t *ns)
+{
+	struct mbstamp st;
+	unsigned i, j;
+	int result;
+
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork_cpu(name, NULL,
+					 cpus ? cpus[i] : curcpu->c_self,
+					 func, NULL, i);
+		if (result) {
+			kprintf("%s: thread_fork failed: %s\n", name,
+				strerror(result));
+			mb_iters = 0;
+			for (j=0; j<i; j++) {
+				V(mb_start);
+			}
+			for (j=0; j<i; j++) {
+				P(mb_done);
+			}
+			return result;
+		}
+	}
+
+	mb_stamp(&st);
+	for (i=0; i<nthreads; i++) {
+		V(mb_start);
+	}
+	for (i=0; i<nthreads; i++) {
+		P(mb_done);
+	}
+	*ns = mb_since(&st);
+	return 0;
+}
+
+/*
+ * Parse "CMD [iterations]" into *ITERS, which holds the default.
+ */
+static
+int
+mb_args(int nargs, char **args, unsigned long *iters)
+{
+	if (nargs > 1) {
+		*iters = atoi(args[1]);
+	}
+	if (nargs > 2 || *iters == 0) {
+		kprintf("Usage: %s [iterations]\n", args[0]);
+		return EINVAL;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// ypb: yield ping-pong
+
+static
+void
+yield_thread(void *junk, unsigned long num)
+{
+	struct mbstamp st;
+	unsigned long i;
+
+	(void)junk;
+	(void)num;
+
+	P(mb_start);
+	for (i=0; i<mb_iters; i++) {
+		mb_stamp(&st);
+		thread_yield();
+		mb_record(mb_since(&st));
+	}
+	V(mb_done);
+}
+
+/*
+ * Usage: ypb [iterations]
+ */
+int
+yieldbench(int nargs, char **args)
+{
+	uint64_t ns;
+	int result;
+
+	mb_iters = YPB_ITERS;
+	result = mb_args(nargs, args, &mb_iters);
+	if (result) {
+		return result;
+	}
+
+	result = mb_setup();
+	if (result) {
+		return result;
+	}
+	result = mb_runthreads("yieldbench", 2, NULL, yield_thread, &ns);
+	if (result == 0) {
+		mb_report("yield", 2, 2 * mb_iters, ns);
+	}
+	mb_cleanup();
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// spb: semaphore ping-pong across CPUs
+
+static struct semaphore *spb_ping;	/* token to the pong thread */
+static struct semaphore *spb_pong;	/* token back to the ping thread */
+
+/*
+ * Each sample is one round trip: the token to the other CPU and back.
+ */
+static
+void
+sem_ping_thread(void *junk, unsigned long num)
+{
+	struct mbstamp st;
+	unsigned long i;
+
+	(void)junk;
+	(void)num;
+
+	P(mb_start);
+	for (i=0; i<mb_iters; i++) {
+		mb_stamp(&st);
+		V(spb_ping);
+		P(spb_pong);
+		mb_record(mb_since(&st));
+	}
+	V(mb_done);
+}
+
+static
+void
+sem_pong_thread(void *junk, unsigned long num)
+{
+	unsigned long i;
+
+	(void)junk;
+	(void)num;
+
+	P(mb_start);
+	for (i=0; i<mb_iters; i++) {
+		P(spb_ping);
+		V(spb_pong);
+	}
+	V(mb_done);
+}
+
+static
+void
+sem_thread(void *junk, unsigned long num)
+{
+	if (num == 0) {
+		sem_ping_thread(junk, num);
+	}
+	else {
+		sem_pong_thread(junk, num);
+	}
+}
+
+/*
+ * Usage: spb [iterations]
+ *
+ * The ping thread runs on this CPU and the pong thread on another
+ * online one, if there is one.
+ */
+int
+sembench(int nargs, char **args)
+{
+	struct cpu *cpus[2], *c;
+	uint64_t ns;
+	unsigned i;
+	int result;
+
+	mb_iters = SPB_ITERS;
+	result = mb_args(nargs, args, &mb_iters);
+	if (result) {
+		return result;
+	}
+
+	cpus[0] = cpus[1] = curcpu->c_self;
+	for (i=0; i < cpus_count(); i++) {
+		c = cpus_get(i);
+		if (c != cpus[0] && cpus_isonline(c)) {
+			cpus[1] = c;
+			break;
+		}
+	}
+	if (cpus[1] == cpus[0]) {
+		kprintf("spb: only one CPU online; both threads share it\n");
+	}
+
+	spb_ping = sem_create("sembench ping", 0);
+	spb_pong = sem_create("sembench pong", 0);
+	if (spb_ping == NULL || spb_pong == NULL) {
+		result = ENOMEM;
+		goto out;
+	}
+	result = mb_setup();
+	if (result) {
+		goto out;
+	}
+
+	result = mb_runthreads("sembench", 2, cpus, sem_thread, &ns);
+	if (result == 0) {
+		mb_report("sem_pingpong", 2, mb_iters, ns);
+	}
+
+	mb_cleanup();
+ out:
+	if (spb_pong != NULL) {
+		sem_destroy(spb_pong);
+	}
+	if (spb_ping != NULL) {
+		sem_destroy(spb_ping);
+	}
+	spb_pong = spb_ping = NULL;
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// lcb: lock contention
+
+static struct lock *lcb_lock;
+static volatile unsigned long lcb_count;
+
+/*
+ * Each sample is the time to get the lock.
+ */
+static
+void
+lock_thread(void *junk, unsigned long num)
+{
+	struct mbstamp st;
+	unsigned long i;
+
+	(void)junk;
+	(void)num;
+
+	P(mb_start);
+	for (i=0; i<mb_iters; i++) {
+		mb_stamp(&st);
+		lock_acquire(lcb_lock);
+		mb_record(mb_since(&st));
+		lcb_count++;
+		lock_release(lcb_lock);
+	}
+	V(mb_done);
+}
+
+/*
+ * Usage: lcb [threads [iterations]]
+ *
+ * The threads are spread round-robin over the online CPUs.
+ */
+int
+lockbench(int nargs, char **args)
+{
+	struct cpu **cpus, *c;
+	unsigned long nthreads;
+	unsigned i, j;
+	uint64_t ns;
+	int result;
+
+	nthreads = LCB_THREADS;
+	mb_iters = LCB_ITERS;
+	if (nargs > 1) {
+		nthreads = atoi(args[1]);
+	}
+	if (nargs > 2) {
+		mb_iters = atoi(args[2]);
+	}
+	if (nargs > 3 || nthreads == 0 || mb_iters == 0) {
+		kprintf("Usage: lcb [threads [iterations]]\n");
+		return EINVAL;
+	}
+	if (nthreads > LCB_MAXTHREADS) {
+		kprintf("lcb: at most %u threads\n", LCB_MAXTHREADS);
+		return EINVAL;
+	}
+
+	cpus = kmalloc(nthreads * sizeof(cpus[0]));
+	if (cpus == NULL) {
+		return ENOMEM;
+	}
+	lcb_lock = lock_create("lockbench");
+	if (lcb_lock == NULL) {
+		kfree(cpus);
+		return ENOMEM;
+	}
+	j = 0;
+	for (i=0; i<nthreads; i++) {
+		do {
+			c = cpus_get(j++ % cpus_count());
+		} while (!cpus_isonline(c));
+		cpus[i] = c;
+	}
+	result = mb_setup();
+	if (result) {
+		goto out;
+	}
+
+	lcb_count = 0;
+	result = mb_runthreads("lockbench", nthreads, cpus, lock_thread, &ns);
+	if (result == 0) {
+		KASSERT(lcb_count == nthreads * mb_iters);
+		mb_report("lock", nthreads, nthreads * mb_iters, ns);
+	}
+
+	mb_cleanup();
+ out:
+	lock_destroy(lcb_lock);
+	lcb_lock = NULL;
+	kfree(cpus);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// feb: thread_fork and exit
+
+static
+void
+exit_thread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(mb_done);
+}
+
+/*
+ * Usage: feb [iterations]
+ *
+ * Each sample runs from the thread_fork call until the new thread
+ * has run; the thread is reaped in the background afterwards, which
+ * is included in the wall time but not in the samples.
+ */
+int
+forkexitbench(int nargs, char **args)
+{
+	struct mbstamp total, st;
+	unsigned long i;
+	uint64_t ns;
+	int result;
+
+	mb_iters = FEB_ITERS;
+	result = mb_args(nargs, args, &mb_iters);
+	if (result) {
+		return result;
+	}
+
+	result = mb_setup();
+	if (result) {
+		return result;
+	}
+	mb_stamp(&total);
+	for (i=0; i<mb_iters; i++) {
+		mb_stamp(&st);
+		result = thread_fork("forkexitbench", NULL,
+				     exit_thread, NULL, 0);
+		if (result) {
+			kprintf("feb: thread_fork failed: %s\n",
+				strerror(result));
+			mb_cleanup();
+			return result;
+		}
+		P(mb_done);
+		mb_record(mb_since(&st));
+	}
+	ns = mb_since(&total);
+	mb_report("fork_exit", 1, mb_iters, ns);
+	mb_cleanup();
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// kmb: kmalloc/kfree
+
+/*
+ * Usage: kmb [iterations]
+ *
+ * Each sample is one kmalloc and the kfree of the same block.
+ */
+int
+mallocbench(int nargs, char **args)
+{
+	static const size_t sizes[] = { 16, 64, 256, 1024, 4096 };
+	struct mbstamp total, st;
+	char name[32];
+	unsigned long i;
+	unsigned s;
+	uint64_t ns;
+	void *p;
+	int result;
+
+	mb_iters = KMB_ITERS;
+	result = mb_args(nargs, args, &mb_iters);
+	if (result) {
+		return result;
+	}
+
+	result = mb_setup();
+	if (result) {
+		return result;
+	}
+	for (s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+		mb_stamp(&total);
+		for (i=0; i<mb_iters; i++) {
+			mb_stamp(&st);
+			p = kmalloc(sizes[s]);
+			if (p == NULL) {
+				mb_cleanup();
+				return ENOMEM;
+			}
+			kfree(p);
+			mb_record(mb_since(&st));
+		}
+		ns = mb_since(&total);
+		snprintf(name, sizeof(name), "kmalloc_%lu",
+			 (unsigned long)sizes[s]);
+		mb_report(name, 1, mb_iters, ns);
+	}
+	mb_cleanup();
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// csb: clock_sleepns accuracy
+
+/*
+ * Usage: csb [iterations]
+ *
+ * Each sample is how far past the requested length one sleep ran.
+ * Sleeps end on a clock tick, so expect up to a tick of oversleep.
+ */
+int
+clocksleepbench(int nargs, char **args)
+{
+	static const unsigned lengths_ms[] = { 1, 5, 20 };
+	struct mbstamp total, st;
+	char name[32];
+	unsigned long i;
+	unsigned l;
+	uint64_t want, ns;
+	int result;
+
+	mb_iters = CSB_ITERS;
+	result = mb_args(nargs, args, &mb_iters);
+	if (result) {
+		return result;
+	}
+
+	result = mb_setup();
+	if (result) {
+		return result;
+	}
+	for (l=0; l<sizeof(lengths_ms)/sizeof(lengths_ms[0]); l++) {
+		want = (uint64_t)lengths_ms[l] * 1000000;
+		mb_stamp(&total);
+		for (i=0; i<mb_iters; i++) {
+			mb_stamp(&st);
+			result = clock_sleepns(want);
+			if (result) {
+				kprintf("csb: %s\n", strerror(result));
+				mb_cleanup();
+				return result;
+			}
+			ns = mb_since(&st);
+			mb_record(ns > want ? ns - want : 0);
+		}
+		ns = mb_since(&total);
+		snprintf(name, sizeof(name), "clocksleep_%ums",
+			 lengths_ms[l]);
+		mb_report(name, 1, mb_iters, ns);
+	}
+	mb_cleanup();
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// all of the above
+
+/*
+ * Usage: bench
+ */
+int
+microbench(int nargs, char **args)
+{
+	static const struct {
+		const char *name;
+		int (*func)(int, char **);
+	} benches[] = {
+		{ "ypb", yieldbench },
+		{ "spb", sembench },
+		{ "lcb", lockbench },
+		{ "feb", forkexitbench },
+		{ "kmb", mallocbench },
+		{ "csb", clocksleepbench },
+	};
+	char *bargs[1];
+	unsigned i;
+	int result;
+
+	if (nargs > 1) {
+		kprintf("Usage: %s\n", args[0]);
+		return EINVAL;
+	}
+
+	for (i=0; i<sizeof(benches)/sizeof(benches[0]); i++) {
+		bargs[0] = (char *)benches[i].name;
+		result = benches[i].func(1, bargs);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,412 @@
+/*
+ * Process id allocation and exit status tracking. See pid.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/wait.h>
+#include <limits.h>
+#include <lib.h>
+#include <synch.h>
+#include <pid.h>
+
+/* Hash table size; must be a power of 2. */
+#define PID_HASHSIZE	1024
+#define PID_HASH(pid)	((unsigned)(pid) & (PID_HASHSIZE - 1))
+
+/* Bitmap geometry. */
+#define PID_WORDBITS	32
+#define PID_NWORDS	((PID_MAX + PID_WORDBITS) / PID_WORDBITS)
+
+struct pidinfo {
+	pid_t pi_pid;
+	struct pidinfo *pi_parent;	/* NULL if orphaned */
+	bool pi_exited;
+	int pi_exitcode;
+	struct cv *pi_childcv;		/* signalled when a child exits */
+
+	struct pidinfo *pi_hashnext;	/* hash chain */
+
+	/*
+	 * Children: running ones on pi_children and exited ones on
+	 * pi_zombies, each a doubly linked list threaded through
+	 * pi_sibling. A child is on exactly one of its parent's lists.
+	 * pi_zombies is kept in the order the children exited, oldest
+	 * first; pi_zombietail points at the last pi_sibling on it (or
+	 * at pi_zombies when it is empty).
+	 */
+	struct pidinfo *pi_children;
+	struct pidinfo *pi_zombies;
+	struct pidinfo **pi_zombietail;
+	struct pidinfo *pi_sibling;
+	struct pidinfo **pi_prevsibling;
+};
+
+static struct lock *pid_lock;		/* protects everything below */
+static uint32_t pid_bitmap[PID_NWORDS];	/* in-use pids */
+static pid_t pid_next;			/* allocation cursor */
+static unsigned pid_inuse;		/* number of bits set */
+static struct pidinfo *pid_hash[PID_HASHSIZE];
+
+void
+pid_bootstrap(void)
+{
+	unsigned i;
+
+	pid_lock = lock_create("pid");
+	if (pid_lock == NULL) {
+		panic("pid_bootstrap: out of memory\n");
+	}
+
+	for (i=0; i<PID_NWORDS; i++) {
+		pid_bitmap[i] = 0;
+	}
+	for (i=0; i<PID_HASHSIZE; i++) {
+		pid_hash[i] = NULL;
+	}
+	pid_next = PID_MIN;
+	pid_inuse = 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Internal helpers. All of these require pid_lock.
+
+static
+bool
+pid_isset(pid_t pid)
+{
+	return (pid_bitmap[pid / PID_WORDBITS] &
+		((uint32_t)1 << (pid % PID_WORDBITS))) != 0;
+}
+
+/*
+ * Find a free pid at or after the cursor, wrapping around once.
+ * Whole words that are full are skipped without looking at their
+ * bits.
+ */
+static
+pid_t
+pid_findfree(void)
+{
+	unsigned tries;
+	pid_t pid;
+
+	KASSERT(lock_do_i_hold(pid_lock));
+
+	if (pid_inuse >= PID_MAX - PID_MIN + 1) {
+		return 0;
+	}
+
+	pid = pid_next;
+	for (tries = 0; tries <= PID_MAX - PID_MIN + 1; ) {
+		if (pid > PID_MAX) {
+			pid = PID_MIN;
+		}
+		if (pid % PID_WORDBITS == 0 &&
+		    pid_bitmap[pid / PID_WORDBITS] == 0xffffffff) {
+			pid += PID_WORDBITS;
+			tries += PID_WORDBITS;
+			continue;
+		}
+		if (!pid_isset(pid)) {
+			return pid;
+		}
+		pid++;
+		tries++;
+	}
+	return 0;
+}
+
+static
+struct pidinfo *
+pid_lookup(pid_t pid)
+{
+	struct pidinfo *pi;
+
+	KASSERT(lock_do_i_hold(pid_lock));
+
+	if (pid < PID_MIN || pid > PID_MAX) {
+		return NULL;
+	}
+	for (pi = pid_hash[PID_HASH(pid)]; pi != NULL; pi = pi->pi_hashnext) {
+		if (pi->pi_pid == pid) {
+			return pi;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Put CHILD at the head of LIST, one of PARENT's child lists.
+ */
+static
+void
+pid_addchild(struct pidinfo *parent, struct pidinfo **list,
+	     struct pidinfo *child)
+{
+	child->pi_parent = parent;
+	child->pi_sibling = *list;
+	if (child->pi_sibling != NULL) {
+		child->pi_sibling->pi_prevsibling = &child->pi_sibling;
+	}
+	child->pi_prevsibling = list;
+	*list = child;
+}
+
+/*
+ * Put CHILD at the tail of PARENT's exited list.
+ */
+static
+void
+pid_addzombie(struct pidinfo *parent, struct pidinfo *child)
+{
+	child->pi_parent = parent;
+	child->pi_sibling = NULL;
+	child->pi_prevsibling = parent->pi_zombietail;
+	*parent->pi_zombietail = child;
+	parent->pi_zombietail = &child->pi_sibling;
+}
+
+/*
+ * Take CHILD off whichever of its parent's lists it is on.
+ */
+static
+void
+pid_remchild(struct pidinfo *child)
+{
+	KASSERT(child->pi_parent != NULL);
+
+	if (child->pi_parent->pi_zombietail == &child->pi_sibling) {
+		/* last on the exited list */
+		child->pi_parent->pi_zombietail = child->pi_prevsibling;
+	}
+	*child->pi_prevsibling = child->pi_sibling;
+	if (child->pi_sibling != NULL) {
+		child->pi_sibling->pi_prevsibling = child->pi_prevsibling;
+	}
+	child->pi_parent = NULL;
+	child->pi_sibling = NULL;
+	child->pi_prevsibling = NULL;
+}
+
+/*
+ * Unhash PI, clear its bit, and free it. It must have no parent; its
+ * children, if any, must already have been orphaned.
+ */
+static
+void
+pid_free(struct pidinfo *pi)
+{
+	struct pidinfo **pp;
+
+	KASSERT(lock_do_i_hold(pid_lock));
+	KASSERT(pi->pi_parent == NULL);
+	KASSERT(pi->pi_children == NULL);
+	KASSERT(pi->pi_zombies == NULL);
+
+	for (pp = &pid_hash[PID_HASH(pi->pi_pid)]; *pp != pi;
+	     pp = &(*pp)->pi_hashnext) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = pi->pi_hashnext;
+
+	KASSERT(pid_isset(pi->pi_pid));
+	pid_bitmap[pi->pi_pid / PID_WORDBITS] &=
+		~((uint32_t)1 << (pi->pi_pid % PID_WORDBITS));
+	pid_inuse--;
+
+	cv_destroy(pi->pi_childcv);
+	kfree(pi);
+}
+
+/*
+ * Detach all of PI's children. Those that have already exited have
+ * nobody left to collect them and are freed now.
+ */
+static
+void
+pid_orphan_children(struct pidinfo *pi)
+{
+	struct pidinfo *child;
+
+	while ((child = pi->pi_children) != NULL) {
+		pid_remchild(child);
+	}
+	while ((child = pi->pi_zombies) != NULL) {
+		pid_remchild(child);
+		pid_free(child);
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Interface.
+
+int
+pid_alloc(pid_t ppid, pid_t *ret)
+{
+	struct pidinfo *pi, *parent;
+	pid_t pid;
+
+	pi = kmalloc(sizeof(*pi));
+	if (pi == NULL) {
+		return ENOMEM;
+	}
+	pi->pi_childcv = cv_create("pid");
+	if (pi->pi_childcv == NULL) {
+		kfree(pi);
+		return ENOMEM;
+	}
+	pi->pi_exited = false;
+	pi->pi_exitcode = 0;
+	pi->pi_children = NULL;
+	pi->pi_zombies = NULL;
+	pi->pi_zombietail = &pi->pi_zombies;
+	pi->pi_parent = NULL;
+	pi->pi_sibling = NULL;
+	pi->pi_prevsibling = NULL;
+
+	lock_acquire(pid_lock);
+
+	pid = pid_findfree();
+	if (pid == 0) {
+		lock_release(pid_lock);
+		cv_destroy(pi->pi_childcv);
+		kfree(pi);
+		return ENPROC;
+	}
+	pid_next = pid + 1;
+
+	pi->pi_pid = pid;
+	pid_bitmap[pid / PID_WORDBITS] |= (uint32_t)1 << (pid % PID_WORDBITS);
+	pid_inuse++;
+	pi->pi_hashnext = pid_hash[PID_HASH(pid)];
+	pid_hash[PID_HASH(pid)] = pi;
+
+	if (ppid != PID_NOPARENT) {
+		parent = pid_lookup(ppid);
+		KASSERT(parent != NULL);
+		pid_addchild(parent, &parent->pi_children, pi);
+	}
+
+	lock_release(pid_lock);
+
+	*ret = pid;
+	return 0;
+}
+
+void
+pid_unalloc(pid_t pid)
+{
+	struct pidinfo *pi;
+
+	lock_acquire(pid_lock);
+	pi = pid_lookup(pid);
+	KASSERT(pi != NULL);
+	KASSERT(!pi->pi_exited);
+	KASSERT(pi->pi_children == NULL);
+	KASSERT(pi->pi_zombies == NULL);
+	if (pi->pi_parent != NULL) {
+		pid_remchild(pi);
+	}
+	pid_free(pi);
+	lock_release(pid_lock);
+}
+
+void
+pid_exit(pid_t pid, int exitcode)
+{
+	struct pidinfo *pi, *parent;
+
+	lock_acquire(pid_lock);
+	pi = pid_lookup(pid);
+	KASSERT(pi != NULL);
+	KASSERT(!pi->pi_exited);
+
+	pi->pi_exited = true;
+	pi->pi_exitcode = exitcode;
+	pid_orphan_children(pi);
+
+	parent = pi->pi_parent;
+	if (parent == NULL) {
+		/* nobody will ever wait for us */
+		pid_free(pi);
+	}
+	else {
+		/* move to the end of the parent's exited list and tell it */
+		pid_remchild(pi);
+		pid_addzombie(parent, pi);
+		cv_broadcast(parent->pi_childcv, pid_lock);
+	}
+	lock_release(pid_lock);
+}
+
+/*
+ * Sleep on PARENT's child channel until child PI (or, if PI is NULL,
+ * any child) has exited, and return the exited child. Returns NULL if
+ * WNOHANG is set and nothing has exited yet.
+ */
+static
+struct pidinfo *
+pid_wait_child(struct pidinfo *parent, struct pidinfo *pi, int options)
+{
+	KASSERT(lock_do_i_hold(pid_lock));
+
+	while (1) {
+		if (pi == NULL && parent->pi_zombies != NULL) {
+			return parent->pi_zombies;
+		}
+		if (pi != NULL && pi->pi_exited) {
+			return pi;
+		}
+		if (options & WNOHANG) {
+			return NULL;
+		}
+		cv_wait(parent->pi_childcv, pid_lock);
+	}
+}
+
+int
+pid_wait(pid_t ppid, pid_t pid, int options, pid_t *retpid, int *exitcode)
+{
+	struct pidinfo *parent, *pi;
+
+	lock_acquire(pid_lock);
+	parent = pid_lookup(ppid);
+	KASSERT(parent != NULL);
+
+	if (pid == PID_ANY) {
+		if (parent->pi_children == NULL && parent->pi_zombies == NULL) {
+			lock_release(pid_lock);
+			return ECHILD;
+		}
+		pi = NULL;
+	}
+	else {
+		pi = pid_lookup(pid);
+		if (pi == NULL) {
+			lock_release(pid_lock);
+			return ESRCH;
+		}
+		if (pi->pi_parent != parent) {
+			lock_release(pid_lock);
+			return ECHILD;
+		}
+	}
+
+	pi = pid_wait_child(parent, pi, options);
+	if (pi == NULL) {
+		/* WNOHANG and nothing to collect */
+		lock_release(pid_lock);
+		*retpid = 0;
+		return 0;
+	}
+
+	*retpid = pi->pi_pid;
+	*exitcode = pi->pi_exitcode;
+	pid_remchild(pi);
+	pid_free(pi);
+	lock_release(pid_lock);
+	return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef _PID_H_
+#define _PID_H_
+
+/*
+ * Process ids.
+ *
+ * Pids are tracked here, independently of struct proc, because a
+ * pid has to outlive its process: after a process exits its pid and
+ * exit code stay around until the parent collects them with waitpid
+ * (or the parent itself exits).
+ *
+ * Allocation uses a bitmap and a rotating cursor: a new pid is the
+ * first free one at or after the last one handed out, so searching is
+ * O(1) amortized and a freed pid is not reused until the cursor has
+ * wrapped all the way around. That keeps a parent that waits on a
+ * stale pid from accidentally collecting an unrelated new process.
+ *
+ * Lookup is through a hash table keyed by pid, and each pid keeps
+ * lists of its running and exited children, so nothing here scans all
+ * processes. A parent sleeps on a single per-parent channel that any
+ * of its children signal when they exit, so waiting for "any child"
+ * costs one wakeup no matter how many children there are.
+ *
+ * Functions:
+ *     pid_bootstrap - initialize; call once before any pids are made.
+ *     pid_alloc     - allocate a pid whose parent is PPID (which may
+ *                     be PID_NOPARENT). Fails with ENPROC if all pids
+ *                     are in use.
+ *     pid_unalloc   - release a pid from pid_alloc whose process never
+ *                     ran (e.g. fork failed part way).
+ *     pid_exit      - record that PID exited with EXITCODE and wake
+ *                     anyone waiting for it. Children of PID become
+ *                     orphans; orphans' pids are freed when they exit.
+ *     pid_wait      - wait for child PID of PPID to exit, return its
+ *                     pid in RETPID and its exit code in EXITCODE, and
+ *                     free the pid. PID may be PID_ANY to take
+ *                     whichever child exits first. With WNOHANG in
+ *                     OPTIONS, returns at once with RETPID 0 if no
+ *                     suitable child has exited yet. Fails with ESRCH
+ *                     if PID does not exist, or ECHILD if it is not a
+ *                     child of PPID (or, for PID_ANY, if PPID has no
+ *                     children at all).
+ */
+
+/* Parent value for processes nobody will wait for (e.g. from the menu). */
+#define PID_NOPARENT 0
+
+/* pid_wait argument meaning "any child", as for waitpid. */
+#define PID_ANY (-1)
+
+void pid_bootstrap(void);
+int pid_alloc(pid_t ppid, pid_t *ret);
+void pid_unalloc(pid_t pid);
+void pid_exit(pid_t pid, int exitcode);
+int pid_wait(pid_t ppid, pid_t pid, int options,
+	     pid_t *retpid, int *exitcode);
+
+#endif /* _PID_H_ */
@@ -9,6 +9,13 @@
 #include <thread.h>
 #include <addrspace.h>
 #include <copyinout.h>
+#include <tlbbatch.h>
+#if OPT_A2
+#include <filetable.h>
+#include <conbuf.h>
+#include <pid.h>
+#include <asreaper.h>
+#endif /* OPT_A2 */
 
   /* this implementation of sys__exit does not do anything with the exit code */
   /* this needs to be fixed to get exit() and waitpid() working properly */
@@ -20,7 +27,21 @@ void sys__exit(int exitcode) {
   /* for now, just include this to keep the compiler from complaining about
      an unused variable */
 #if OPT_A2
-        set_exitcode(exitcode);
+        /* make sure our console output appears before whatever the
+           menu or our parent prints once it is told we are gone. this
+           waits for our own output (and what was queued ahead of it),
+           not for other processes that are still writing */
+        if (p->p_filetable != NULL) {
+                uint64_t seq;
+
+                spinlock_acquire(&p->p_filetable->ft_lock);
+                seq = p->p_filetable->ft_conseq;
+                spinlock_release(&p->p_filetable->ft_lock);
+                conbuf_flush_to(seq);
+        }
+
+        /* publish our exit code and wake our parent if it is waiting */
+        pid_exit(p->pid, exitcode);
 #else
   (void)exitcode;
 #endif /* OPT_A2 */
@@ -37,7 +58,22 @@ void sys__exit(int exitcode) {
    * messily fatal.
    */
   as = curproc_setas(NULL);
+#if OPT_A2
+  /* freeing the pages can take a while and nobody needs to wait for
+     it; our parent has already been told we are gone */
+  asreaper_defer(as);
+#else
+  tlbbatch_forget(as);
   as_destroy(as);
+#endif /* OPT_A2 */
+
+#if OPT_A2
+  /* close all of our open files */
+  if (p->p_filetable != NULL) {
+    filetable_destroy(p->p_filetable);
+    p->p_filetable = NULL;
+  }
+#endif /* OPT_A2 */
 
   /* detach this thread from its process */
   /* note: curproc cannot be used after this call */
@@ -88,7 +124,7 @@ sys_waitpid(pid_t pid,
   */
 #if OPT_A2
         // check if the options argument requested invalid or unsupported options
-        if (options != 0) {
+        if (options & ~WNOHANG) {
                 return EINVAL;
         }
         
@@ -97,17 +133,25 @@ sys_waitpid(pid_t pid,
                 return EFAULT;
         }
         
-        // check if the pid argument named a nonexistent process
-        if (!is_exists(pid)) {
-                return ESRCH;
-
-        // if the pid argument named a process that the current
-        // process was not interested in or terminate with error,
-        // raise error. Otherwise save exitcode in exitstatus
-        } else if (!get_child_exitcode(pid, &exitstatus)) {
-                exitstatus = _MKWAIT_STOP(0);
-                copyout((void *)&exitstatus,status,sizeof(int));
-                return ECHILD;
+        // only "a specific child" and "any child" are supported;
+        // there are no process groups
+        if (pid < 0 && pid != PID_ANY) {
+                return EINVAL;
+        }
+
+        // wait for the child (or any child, for pid -1) to exit and
+        // collect its exit code. this fails with ESRCH if the pid
+        // names no process and with ECHILD if it is not our child
+        result = pid_wait(curproc->pid, pid, options, &pid, &exitstatus);
+        if (result) {
+                return result;
+        }
+
+        // WNOHANG and no child has exited yet: report pid 0 and
+        // leave status alone
+        if (pid == 0) {
+                *retval = 0;
+                return 0;
         }
 
         // encode the exitstatus. only if the process exit
@@ -132,21 +176,35 @@ sys_waitpid(pid_t pid,
 #if OPT_A2
 int
 sys_fork(struct trapframe* tf, pid_t* retval) {
-        if (!can_create_proc()) return ENPROC;
-
         // create a new process, make them to be parent - child relation
         struct proc* new_proc = proc_create_runprogram(curproc->p_name);
         if (new_proc == NULL) return ENOMEM;
+
+        int err = pid_alloc(curproc->pid, &new_proc->pid);
+        if (err) {
+                proc_destroy(new_proc);
+                return err;
+        }
         *retval = new_proc->pid;
 
         // create a new address space and copy it
         struct addrspace* as;
-        int err = as_copy(curproc_getas(), &as);
+        err = as_copy(curproc_getas(), &as);
         if (err) {
+                pid_unalloc(new_proc->pid);
                 proc_destroy(new_proc);
                 return err;
         }
 
+        // the child shares the parent's open files (and their offsets)
+        err = filetable_copy(curproc->p_filetable, &new_proc->p_filetable);
+        if (err) {
+                pid_unalloc(new_proc->pid);
+                proc_destroy(new_proc);
+                as_destroy(as);
+                return err;
+        }
+
         // simply pass tf and as to new forked process,
         // the new process would activate the as and setup the tf
         new_proc->p_addrspace = as;
@@ -156,6 +214,9 @@ sys_fork(struct trapframe* tf, pid_t* retval) {
                               tf /* thread arg */, 0 /* thread arg */);
         if (err) {
                 new_proc->p_addrspace = NULL;
+                filetable_destroy(new_proc->p_filetable);
+                new_proc->p_filetable = NULL;
+                pid_unalloc(new_proc->pid);
                 proc_destroy(new_proc);
                 as_destroy(as);
                 return err;
@@ -44,11 +44,40 @@
 #include <vfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <tlbbatch.h>
 #if OPT_A2
 #include <limits.h>
 #include <copyinout.h>
+#include <synch.h>
+#include <thread.h>
+#include <filetable.h>
+#include <pid.h>
+#include <argpack.h>
+#include <asreaper.h>
 #endif /* OPT_A2 */
 
+/*
+ * Take away and destroy the address space runprogram or sys_execv
+ * set up, when loading fails, and go back to PREV (NULL for a new
+ * process). Leaving it for proc_destroy would skip tlbbatch_forget,
+ * and a later address space at the same address could be taken for
+ * it.
+ */
+static
+void
+runprogram_dropas(struct addrspace *prev)
+{
+	struct addrspace *as;
+
+	as_deactivate();
+	as = curproc_setas(prev);
+	tlbbatch_forget(as);
+	as_destroy(as);
+	if (prev != NULL) {
+		tlbbatch_activate();
+	}
+}
+
 /*
  * Load program "progname" and start running it in usermode.
  * Does not return except on error.
@@ -82,6 +111,22 @@ runprogram(char *progname)
 	/* We should be a new process. */
 	KASSERT(curproc_getas() == NULL);
 
+#if OPT_A2
+        /* give the new process stdin, stdout and stderr */
+        KASSERT(curproc->p_filetable == NULL);
+        curproc->p_filetable = filetable_create();
+        if (curproc->p_filetable == NULL) {
+                vfs_close(v);
+                return ENOMEM;
+        }
+        result = filetable_init_console(curproc->p_filetable);
+        if (result) {
+                /* p_filetable will go away when curproc is destroyed */
+                vfs_close(v);
+                return result;
+        }
+#endif /* OPT_A2 */
+
 	/* Create a new address space. */
 	as = as_create();
 	if (as ==NULL) {
@@ -91,12 +136,12 @@ runprogram(char *progname)
 
 	/* Switch to it and activate it. */
 	curproc_setas(as);
-	as_activate();
+	tlbbatch_activate();
 
 	/* Load the executable. */
 	result = load_elf(v, &entrypoint);
 	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
+		runprogram_dropas(NULL);
 		vfs_close(v);
 		return result;
 	}
@@ -107,43 +152,25 @@ runprogram(char *progname)
 	/* Define the user stack in the address space */
 	result = as_define_stack(as, &stackptr);
 	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
+		runprogram_dropas(NULL);
 		return result;
 	}
 
 #if OPT_A2
-        char* argv[nargs + 1];
-        argv[nargs] = NULL;
-        size_t len;
-        for (int i = nargs - 1; i >= 0; --i) {
-                /* find the lenth of argument and align the lenth */
-                len = strlen(args[i]) + 1;
-                if (len % 4) len += 4 - len % 4;
-
-                /* copy out the argument */
-                stackptr -= len;
-                argv[i] = (char *)stackptr;
-                result = copyoutstr(args[i], (userptr_t)stackptr, len, NULL);
-                if (result) {
-                        /* p_addrspace will go away when curproc is destroyed */
-                        return result;
-                }
+        /* put the arguments on the new stack */
+        struct argpack packed;
+        userptr_t argvs;
+        result = argpack_kinit(&packed, nargs, args);
+        if (result) {
+                runprogram_dropas(NULL);
+                return result;
+        }
+        result = argpack_copyout(&packed, &stackptr, &argvs);
+        argpack_cleanup(&packed);
+        if (result) {
+                runprogram_dropas(NULL);
+                return result;
         }
-
-        /* setup the char**, which is argv, on the user-space stack */
-        /* make sure the stack is aligned */
-        if (stackptr % 4) stackptr -= 4 - stackptr % 4;
-
-        stackptr -= sizeof(char *) * (nargs + 1);
-        result = copyout((const void *)argv,
-                         (userptr_t)stackptr,
-                         sizeof(char *) * (nargs + 1));
-        if (result) return result;
-
-        
-        /* make sure the stack is aligned */
-        userptr_t argvs = (userptr_t)stackptr;
-        if (stackptr % 8) stackptr -= 8 - stackptr % 8;
 
         /* Warp to user mode. */
         enter_new_process(nargs /*argc*/, argvs /*userspace addr of argv*/,
@@ -166,14 +193,12 @@ sys_execv(const char *progname, char **argvs)
                 return EFAULT;
         }
 
-        char* argvs_str;
-        int argc = 0;
-        size_t* argvs_len;
-        size_t args_size = 0;
+        struct argpack args;
         size_t len;
-        struct addrspace *as;
+        struct addrspace *as, *oldas;
         struct vnode *v;
         vaddr_t entrypoint, stackptr;
+        userptr_t argv;
         int result;
 
         /* copy the progname from user-space address into
@@ -196,122 +221,268 @@ sys_execv(const char *progname, char **argvs)
         /* We should not be a new process. */
         KASSERT(curproc_getas() != NULL);
 
-        /* count the number of arguments */
-        while (argvs[argc] != NULL) ++argc;
-
-        /* Prepare to copy the arguments into kernel heap*/
-        argvs_str = (char *)kmalloc(sizeof(char) * ARG_MAX);
-        if (argvs_str == NULL) {
-                vfs_close(v);
-                return ENOMEM;
-        }
-
-        argvs_len = (size_t *)kmalloc(sizeof(size_t) * argc);
-        if (argvs_len == NULL) {
-                kfree(argvs_str);
+        result = argpack_copyin(&args, (userptr_t)argvs);
+        if (result) {
                 vfs_close(v);
-                return ENOMEM;
-        }
-
-        /* Start to copy arguments into kernel heap */
-        for (int i = 0; i < argc; ++i) {
-                result = copyinstr((const_userptr_t)argvs[i],
-                                   argvs_str + args_size,
-                                   ARG_MAX - args_size,
-                                   &len);
-                if (result) {
-                        kfree(argvs_len);
-                        kfree(argvs_str);
-                        vfs_close(v);
-
-                        /* check if E2BIG */
-                        if (result == ENAMETOOLONG) return E2BIG;
-                        return result;
-                }
-
-                /* shift bit */
-                if (len % 4) len += 4 - len % 4;
-
-                argvs_len[i] = len;
-                args_size += len;
+                return result;
         }
 
         /* Create a new address space. */
         as = as_create();
         if (as == NULL) {
-                kfree(argvs_len);
-                kfree(argvs_str);
+                argpack_cleanup(&args);
                 vfs_close(v);
                 return ENOMEM;
         }
 
-        /* Destroy the old address space */
+        /* Switch to it, but keep the old one until the load is done
+           so that a failure can still return to the caller */
         as_deactivate();
-        as_destroy(curproc_getas());
-
-        /* Switch to new one and activate it. */
-        curproc_setas(as);
-        as_activate();
+        oldas = curproc_setas(as);
+        tlbbatch_activate();
 
         /* Load the executable. */
         result = load_elf(v, &entrypoint);
         /* Done with the file now. */
         vfs_close(v);
         if (result) {
-                kfree(argvs_len);
-                kfree(argvs_str);
-                /* p_addrspace will go away when curproc is destroyed */
+                argpack_cleanup(&args);
+                runprogram_dropas(oldas);
                 return result;
         }
 
         /* Define the user stack in the address space */
         result = as_define_stack(as, &stackptr);
         if (result) {
-                kfree(argvs_len);
-                kfree(argvs_str);
-                /* p_addrspace will go away when curproc is destroyed */
+                argpack_cleanup(&args);
+                runprogram_dropas(oldas);
                 return result;
         }
 
-        /* modify the user-space stack to pass arguments */
-        stackptr -= args_size;
-        result = copyout(argvs_str, (userptr_t)stackptr, args_size);
-        /* Nolonger to use argvs_str */
-        kfree(argvs_str);
-        argvs_str = (char *)stackptr;
+        result = argpack_copyout(&args, &stackptr, &argv);
+        argpack_cleanup(&args);
         if (result) {
-                kfree(argvs_len);
-                /* p_addrspace will go away when curproc is destroyed */
+                runprogram_dropas(oldas);
                 return result;
         }
 
-        char* temp[(argc + 1)];
-        for (int i = 0; i < argc; ++i) {
-                temp[i] = argvs_str;
-                argvs_str += argvs_len[i];
+        /* No going back now; the reaper frees the old address space */
+        asreaper_defer(oldas);
+
+        /* Warp to user mode. */
+        enter_new_process(args.ap_argc /*argc*/, argv /*userspace addr of argv*/,
+                          stackptr, entrypoint);
+        
+        /* enter_new_process does not return. */
+        panic("enter_new_process returned\n");
+        return EINVAL;
+}
+
+/*
+ * Everything the child of sys_spawn needs to start its program,
+ * handed over by the parent.
+ */
+struct spawnargs {
+        struct vnode *sa_vnode;         /* the open executable */
+        struct argpack sa_args;         /* the arguments */
+        struct semaphore *sa_loaded;    /* V'd once the load is done */
+        int sa_result;                  /* outcome of the load */
+};
+
+/*
+ * The child's half of sys_spawn. Builds a fresh address space, loads
+ * the program into it and sets up its arguments, then reports back to
+ * the parent and goes to user mode. If anything fails the child tears
+ * itself down completely before reporting, so the parent sees a clean
+ * error and never a zombie.
+ */
+static
+void
+spawn_start(void *data, unsigned long unused)
+{
+        struct spawnargs *sa = data;
+        struct proc *p = curproc;
+        struct addrspace *as;
+        vaddr_t entrypoint, stackptr;
+        userptr_t argv;
+        int argc = sa->sa_args.ap_argc;
+        int result;
+
+        (void)unused;
+
+        /* We should be a new process. */
+        KASSERT(curproc_getas() == NULL);
+
+        /* Create a new address space. */
+        as = as_create();
+        if (as == NULL) {
+                vfs_close(sa->sa_vnode);
+                result = ENOMEM;
+                goto fail;
         }
-        temp[argc] = NULL;
-        kfree(argvs_len);
 
-        /* shift bit */
-        if (stackptr % 4) stackptr -= 4 - stackptr % 4;
+        /* Switch to it and activate it. */
+        curproc_setas(as);
+        tlbbatch_activate();
 
-        stackptr -= sizeof(char *) * (argc + 1);
-        result = copyout((const void *)temp,
-                         (userptr_t)stackptr,
-                         sizeof(char *) * (argc + 1));
-        if (result) return result;
+        /* Load the executable. */
+        result = load_elf(sa->sa_vnode, &entrypoint);
+        /* Done with the file now. */
+        vfs_close(sa->sa_vnode);
+        if (result) {
+                goto fail;
+        }
 
-        userptr_t argv = (userptr_t)stackptr;
-        /* shift the stackptr */
-        if (stackptr % 8) stackptr -= 8 - stackptr % 8;
+        /* Define the user stack in the address space */
+        result = as_define_stack(as, &stackptr);
+        if (result) {
+                goto fail;
+        }
+
+        result = argpack_copyout(&sa->sa_args, &stackptr, &argv);
+        if (result) {
+                goto fail;
+        }
+
+        argpack_cleanup(&sa->sa_args);
+
+        /* the parent frees sa once it has the result */
+        sa->sa_result = 0;
+        V(sa->sa_loaded);
 
         /* Warp to user mode. */
         enter_new_process(argc /*argc*/, argv /*userspace addr of argv*/,
                           stackptr, entrypoint);
-        
+
         /* enter_new_process does not return. */
         panic("enter_new_process returned\n");
-        return EINVAL;
+
+ fail:
+        argpack_cleanup(&sa->sa_args);
+
+        as_deactivate();
+        as = curproc_setas(NULL);
+        if (as != NULL) {
+                tlbbatch_forget(as);
+                as_destroy(as);
+        }
+        filetable_destroy(p->p_filetable);
+        p->p_filetable = NULL;
+        pid_unalloc(p->pid);
+
+        proc_remthread(curthread);
+        proc_destroy(p);
+
+        sa->sa_result = result;
+        V(sa->sa_loaded);
+        thread_exit();
+}
+
+/*
+ * spawn: start PROGNAME with arguments ARGVS in a new child process.
+ *
+ * This does what fork followed immediately by execv does, without
+ * ever copying the parent's address space: the child starts out with
+ * no address space at all and builds one by loading the program, as
+ * runprogram does. It inherits the parent's open files like a forked
+ * child.
+ *
+ * The parent waits until the child has loaded the program, so that a
+ * missing or bad executable is reported here rather than showing up
+ * later as an exit status.
+ */
+int
+sys_spawn(const char *progname, char **argvs, pid_t *retval)
+{
+        if (progname == NULL || argvs == NULL) {
+                return EFAULT;
+        }
+
+        struct spawnargs *sa;
+        struct proc *new_proc;
+        pid_t pid;
+        size_t len;
+        int result;
+
+        /* open the program here so that a bad path fails right away */
+        char progname_temp[PATH_MAX];
+        result = copyinstr((const_userptr_t)progname,
+                           progname_temp,
+                           PATH_MAX,
+                           &len);
+        if (result) {
+                return result;
+        }
+
+        sa = kmalloc(sizeof(*sa));
+        if (sa == NULL) {
+                return ENOMEM;
+        }
+        sa->sa_loaded = sem_create("spawn", 0);
+        if (sa->sa_loaded == NULL) {
+                kfree(sa);
+                return ENOMEM;
+        }
+
+        result = vfs_open(progname_temp, O_RDONLY, 0, &sa->sa_vnode);
+        if (result) {
+                goto fail_sa;
+        }
+
+        result = argpack_copyin(&sa->sa_args, (userptr_t)argvs);
+        if (result) {
+                goto fail_vnode;
+        }
+
+        // create the child, with no address space
+        new_proc = proc_create_runprogram(curproc->p_name);
+        if (new_proc == NULL) {
+                result = ENOMEM;
+                goto fail_args;
+        }
+
+        result = pid_alloc(curproc->pid, &new_proc->pid);
+        if (result) {
+                proc_destroy(new_proc);
+                goto fail_args;
+        }
+
+        // the child shares the parent's open files (and their offsets)
+        result = filetable_copy(curproc->p_filetable, &new_proc->p_filetable);
+        if (result) {
+                pid_unalloc(new_proc->pid);
+                proc_destroy(new_proc);
+                goto fail_args;
+        }
+
+        // from here on the child owns the vnode and the arguments, and
+        // new_proc may be destroyed under us, so remember the pid first
+        pid = new_proc->pid;
+        result = thread_fork(curthread->t_name, new_proc,
+                             spawn_start, sa, 0);
+        if (result) {
+                filetable_destroy(new_proc->p_filetable);
+                new_proc->p_filetable = NULL;
+                pid_unalloc(new_proc->pid);
+                proc_destroy(new_proc);
+                goto fail_args;
+        }
+        *retval = pid;
+
+        // wait for the load; if it failed the child is already gone
+        P(sa->sa_loaded);
+        result = sa->sa_result;
+        sem_destroy(sa->sa_loaded);
+        kfree(sa);
+        return result;
+
+ fail_args:
+        argpack_cleanup(&sa->sa_args);
+ fail_vnode:
+        vfs_close(sa->sa_vnode);
+ fail_sa:
+        sem_destroy(sa->sa_loaded);
+        kfree(sa);
+        return result;
 }
 #endif /* OPT_A2 */
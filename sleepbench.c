@@ -0,0 +1,98 @@
+/*
+ * sleepbench.c
+ *
+ * User-level sleep accuracy benchmark. Not part of the kernel: build
+ * it as a testbin program.
+ *
+ * Usage: sleepbench [iterations]
+ *
+ * Sleeps with nanosleep for 1, 5, 10, 50 and 100 milliseconds,
+ * ITERATIONS times each (default 10), timing each sleep with
+ * clock_gettime(CLOCK_MONOTONIC), and prints the mean and worst
+ * oversleep for each length. Sleeps end on a clock tick, so expect
+ * oversleep of up to one tick.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <err.h>
+
+#define DEFAULT_ITERS	10
+
+/* not in libc yet; these match the kernel's */
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC	1
+struct timespec {
+	time_t tv_sec;
+	unsigned long tv_nsec;
+};
+#endif
+int clock_gettime(int clockid, struct timespec *ts);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+
+static
+unsigned long long
+now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
+		err(1, "clock_gettime");
+	}
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static
+void
+run(unsigned ms, int iters)
+{
+	struct timespec req;
+	unsigned long long want, t1, t2, over, total, worst;
+	int i;
+
+	want = ms * 1000000ULL;
+	req.tv_sec = want / 1000000000ULL;
+	req.tv_nsec = want % 1000000000ULL;
+
+	total = worst = 0;
+	for (i=0; i<iters; i++) {
+		t1 = now_ns();
+		if (nanosleep(&req, NULL) < 0) {
+			err(1, "nanosleep");
+		}
+		t2 = now_ns();
+		if (t2 - t1 < want) {
+			errx(1, "slept %llu ns, asked for %llu", t2 - t1, want);
+		}
+		over = t2 - t1 - want;
+		total += over;
+		if (over > worst) {
+			worst = over;
+		}
+	}
+
+	printf("sleepbench ms=%u iters=%d mean_over_ns=%llu max_over_ns=%llu\n",
+	       ms, iters, total / iters, worst);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const unsigned lengths[] = { 1, 5, 10, 50, 100 };
+	int iters = DEFAULT_ITERS;
+	unsigned i;
+
+	if (argc > 1) {
+		iters = atoi(argv[1]);
+	}
+	if (argc > 2 || iters <= 0) {
+		errx(1, "Usage: sleepbench [iterations]");
+	}
+
+	for (i=0; i<sizeof(lengths)/sizeof(lengths[0]); i++) {
+		run(lengths[i], iters);
+	}
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Cross-CPU function calls. See smpcall.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <current.h>
+#include <counter.h>
+#include <smpcall.h>
+
+/*
+ * Per-CPU mailboxes, each protected by its CPU's c_ipi_lock.
+ */
+static struct smpbox {
+	struct smpcall *sb_head;
+	struct smpcall *sb_tail;
+} __attribute__((aligned(PCPU_CACHELINE))) smpboxes[PCPU_MAXCPUS];
+
+void
+smp_call_async(struct cpu *target, struct smpcall *sc,
+	       void (*func)(void *), void *data)
+{
+	struct smpbox *sb;
+	int spl;
+
+	sc->sc_func = func;
+	sc->sc_data = data;
+	sc->sc_done = false;
+	sc->sc_next = NULL;
+
+	/* interrupts off, so we can't migrate off TARGET meanwhile */
+	spl = splhigh();
+	if (target == curcpu->c_self) {
+		smpcall_run(sc);
+		splx(spl);
+		return;
+	}
+	splx(spl);
+
+	KASSERT(target->c_number < PCPU_MAXCPUS);
+	sb = &smpboxes[target->c_number];
+
+	spinlock_acquire(&target->c_ipi_lock);
+	if (sb->sb_tail == NULL) {
+		sb->sb_head = sc;
+	}
+	else {
+		sb->sb_tail->sc_next = sc;
+	}
+	sb->sb_tail = sc;
+	ipi_post(target, IPI_CALL);
+	spinlock_release(&target->c_ipi_lock);
+}
+
+bool
+smp_call_done(struct smpcall *sc)
+{
+	return sc->sc_done;
+}
+
+/*
+ * Spin until the call finishes. The target runs it from its
+ * interrupt handler, which takes no time to get to, so this is
+ * short; and sleeping would mean a wakeup from interrupt context
+ * for every call.
+ */
+void
+smp_call_wait(struct smpcall *sc)
+{
+	KASSERT(curthread->t_curspl == 0);
+
+	while (!sc->sc_done) {
+		/* spin */
+	}
+}
+
+void
+smp_call(struct cpu *target, void (*func)(void *), void *data)
+{
+	struct smpcall sc;
+
+	smp_call_async(target, &sc, func, data);
+	smp_call_wait(&sc);
+}
+
+struct smpcall *
+smpcall_take(void)
+{
+	struct smpbox *sb;
+	struct smpcall *calls;
+
+	KASSERT(spinlock_do_i_hold(&curcpu->c_ipi_lock));
+
+	sb = &smpboxes[curcpu->c_number];
+	calls = sb->sb_head;
+	sb->sb_head = NULL;
+	sb->sb_tail = NULL;
+	return calls;
+}
+
+/*
+ * Run each call in turn. Once sc_done is set the caller may free SC,
+ * so get the next one first.
+ */
+void
+smpcall_run(struct smpcall *calls)
+{
+	struct smpcall *sc, *next;
+
+	for (sc = calls; sc != NULL; sc = next) {
+		next = sc->sc_next;
+		sc->sc_func(sc->sc_data);
+		pcpu_counter_inc(&kstat_smpcalls);
+		sc->sc_done = true;
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef _SMPCALL_H_
+#define _SMPCALL_H_
+
+/*
+ * Cross-CPU function calls.
+ *
+ * smp_call runs a function on another CPU, in that CPU's interrupt
+ * handler, and waits for it to finish; smp_call_async queues it and
+ * returns at once, and the caller can check on it or wait for it
+ * later. This lets work that touches per-CPU state (a run queue, the
+ * TLB, ...) be done by the CPU that owns the state, instead of
+ * reaching across and locking it from outside.
+ *
+ * Each CPU has a mailbox of pending calls, kept in FIFO order. The
+ * mailbox is protected by the target's c_ipi_lock, which sending
+ * the IPI needs anyway, so queueing a call costs no more locking
+ * than a plain ipi_send. Calls run with interrupts off and must not
+ * sleep.
+ *
+ * IPIs are coalesced: if the target already has an interrupt pending
+ * (of any kind), posting another just sets its bit, since the
+ * handler takes all the bits at once. So a burst of calls or
+ * shootdowns to one CPU costs one interrupt.
+ *
+ * The caller owns the struct smpcall for an async call and must keep
+ * it alive until the call is done. A call to the current CPU just
+ * runs the function on the spot, async or not.
+ *
+ * Functions:
+ *     smp_call       - run FUNC(DATA) on TARGET and wait for it. The
+ *                      caller must have interrupts on, since the
+ *                      target may be trying to call it meanwhile.
+ *     smp_call_async - start running FUNC(DATA) on TARGET, using SC.
+ *     smp_call_done  - true once the call in SC has finished.
+ *     smp_call_wait  - wait for the call in SC to finish (same rule
+ *                      as smp_call about interrupts).
+ *
+ * Lower level, for the IPI code:
+ *     ipi_post       - post IPI CODE to TARGET; the caller holds
+ *                      TARGET's c_ipi_lock.
+ *     smpcall_take   - empty the current CPU's mailbox (under its
+ *                      c_ipi_lock) and return what was in it.
+ *     smpcall_run    - run a list returned by smpcall_take.
+ */
+
+/* Not among the IPI codes in cpu.h yet. */
+#ifndef IPI_CALL
+#define IPI_CALL	4
+#endif
+
+struct cpu;
+
+struct smpcall {
+	void (*sc_func)(void *data);	/* what to call */
+	void *sc_data;			/* and its argument */
+	volatile bool sc_done;		/* set once sc_func has returned */
+	struct smpcall *sc_next;	/* mailbox chain */
+};
+
+void smp_call(struct cpu *target, void (*func)(void *), void *data);
+void smp_call_async(struct cpu *target, struct smpcall *sc,
+		    void (*func)(void *), void *data);
+bool smp_call_done(struct smpcall *sc);
+void smp_call_wait(struct smpcall *sc);
+
+void ipi_post(struct cpu *target, int code);
+struct smpcall *smpcall_take(void);
+void smpcall_run(struct smpcall *calls);
+
+#endif /* _SMPCALL_H_ */
@@ -0,0 +1,111 @@
+/*
+ * spawnbench.c
+ *
+ * User-level process launch rate benchmark. Not part of the kernel:
+ * build it as a testbin program.
+ *
+ * Usage: spawnbench [nlaunches [program]]
+ *
+ * Launches PROGRAM (default /bin/true) NLAUNCHES times (default 200)
+ * two ways, waiting for each child before starting the next: once
+ * with fork followed by execv in the child, and once with spawn.
+ * Prints the launch rate of each.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#define DEFAULT_LAUNCHES	200
+#define DEFAULT_PROGRAM		"/bin/true"
+
+/* not in libc's unistd.h yet */
+pid_t spawn(const char *path, char **argv);
+
+static
+unsigned long long
+elapsed(time_t s1, unsigned long ns1, time_t s2, unsigned long ns2)
+{
+	return (unsigned long long)(s2 - s1) * 1000000000ULL + ns2 - ns1;
+}
+
+static
+pid_t
+launch_fork(char **args)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid == 0) {
+		execv(args[0], args);
+		_exit(255);
+	}
+	return pid;
+}
+
+static
+pid_t
+launch_spawn(char **args)
+{
+	return spawn(args[0], args);
+}
+
+static
+void
+run(const char *name, pid_t (*launch)(char **), char **args, int n)
+{
+	unsigned long long ns;
+	time_t s1, s2;
+	unsigned long ns1, ns2;
+	pid_t pid;
+	int i, status;
+
+	__time(&s1, &ns1);
+	for (i=0; i<n; i++) {
+		pid = launch(args);
+		if (pid < 0) {
+			err(1, "%s %d", name, i);
+		}
+		if (waitpid(pid, &status, 0) != pid) {
+			err(1, "waitpid %d", pid);
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "%s: %s failed, status %d", name, args[0],
+			     status);
+		}
+	}
+	__time(&s2, &ns2);
+
+	ns = elapsed(s1, ns1, s2, ns2);
+	printf("spawnbench %s launches=%d time_ns=%llu ns_per_launch=%llu "
+	       "launches_per_sec=%llu\n",
+	       name, n, ns, ns / n, ns ? n * 1000000000ULL / ns : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char *args[2];
+	int n = DEFAULT_LAUNCHES;
+
+	args[0] = (char *)DEFAULT_PROGRAM;
+	args[1] = NULL;
+
+	if (argc > 1) {
+		n = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		args[0] = argv[2];
+	}
+	if (argc > 3 || n <= 0) {
+		errx(1, "Usage: spawnbench [nlaunches [program]]");
+	}
+
+	run("forkexec", launch_fork, args, n);
+	run("spawn", launch_spawn, args, n);
+	return 0;
+}
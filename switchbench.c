@@ -0,0 +1,212 @@
+/*
+ * Context switch benchmark.
+ *
+ * Two threads pass a token back and forth through a pair of
+ * semaphores ITERS times, so every handoff is a sleep in one thread
+ * and a wakeup (and usually a switch) in the other. This is run
+ * three ways:
+ *
+ *   kernel  - both threads are kernel threads, with no address space;
+ *   same    - both threads belong to one process;
+ *   two     - each thread belongs to a process of its own.
+ *
+ * The processes get empty address spaces; the threads never go to
+ * user mode, but every switch into them still goes through
+ * tlbbatch_activate. The as_activates column shows how many of the
+ * switches actually reloaded the TLB: with lazy activation it should
+ * be close to zero for "same" and one per switch for "two".
+ *
+ * Run with one CPU for the cleanest numbers; with several, the two
+ * threads may end up on different CPUs and idle instead of
+ * switching.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <counter.h>
+#include <tlbbatch.h>
+#include <bench.h>
+
+#define DEFAULT_ITERS	10000
+
+static struct semaphore *sb_ping;	/* token to the second thread */
+static struct semaphore *sb_pong;	/* token back to the first */
+static struct semaphore *sb_done;	/* threads signal when finished */
+static unsigned long sb_iters;
+
+/*
+ * Leave our process, if any, so thread_exit will take us, then say
+ * we are done.
+ */
+static
+void
+switchbench_finish(void)
+{
+	if (curproc != kproc) {
+		proc_remthread(curthread);
+	}
+	V(sb_done);
+}
+
+static
+void
+ping_thread(void *junk, unsigned long num)
+{
+	unsigned long i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<sb_iters; i++) {
+		V(sb_ping);
+		P(sb_pong);
+	}
+	switchbench_finish();
+}
+
+static
+void
+pong_thread(void *junk, unsigned long num)
+{
+	unsigned long i;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<sb_iters; i++) {
+		P(sb_ping);
+		V(sb_pong);
+	}
+	switchbench_finish();
+}
+
+/*
+ * Make a process with an empty address space for the threads to
+ * run in.
+ */
+static
+struct proc *
+switchbench_proc(void)
+{
+	struct proc *p;
+
+	p = proc_create_runprogram("switchbench");
+	if (p == NULL) {
+		panic("switchbench: out of memory\n");
+	}
+	p->p_addrspace = as_create();
+	if (p->p_addrspace == NULL) {
+		panic("switchbench: out of memory\n");
+	}
+	return p;
+}
+
+static
+void
+switchbench_unproc(struct proc *p)
+{
+	tlbbatch_forget(p->p_addrspace);
+	proc_destroy(p);
+}
+
+/*
+ * Run the two threads in processes P1 and P2 (NULL for kernel
+ * threads) and print the results under NAME.
+ */
+static
+void
+switchbench_run(const char *name, struct proc *p1, struct proc *p2)
+{
+	time_t s1, s2, secs;
+	uint32_t ns1, ns2, nsecs;
+	uint64_t ns, switches, activates;
+	int result;
+
+	switches = pcpu_counter_read(&kstat_switches);
+	activates = pcpu_counter_read(&kstat_as_activates);
+
+	gettime(&s1, &ns1);
+	result = thread_fork("switchbench ping", p1, ping_thread, NULL, 0);
+	if (result) {
+		panic("switchbench: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	result = thread_fork("switchbench pong", p2, pong_thread, NULL, 0);
+	if (result) {
+		panic("switchbench: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	P(sb_done);
+	P(sb_done);
+	gettime(&s2, &ns2);
+	getinterval(s1, ns1, s2, ns2, &secs, &nsecs);
+
+	switches = pcpu_counter_read(&kstat_switches) - switches;
+	activates = pcpu_counter_read(&kstat_as_activates) - activates;
+
+	ns = (uint64_t)secs * 1000000000 + nsecs;
+	kprintf("switchbench %s handoffs=%lu switches=%llu "
+		"as_activates=%llu time=%lu.%09lu ns_per_handoff=%llu\n",
+		name, 2 * sb_iters, (unsigned long long)switches,
+		(unsigned long long)activates,
+		(unsigned long)secs, (unsigned long)nsecs,
+		(unsigned long long)(ns / (2 * sb_iters)));
+}
+
+/*
+ * Usage: swb [iterations]
+ */
+int
+switchbench(int nargs, char **args)
+{
+	struct proc *p1, *p2;
+
+	sb_iters = DEFAULT_ITERS;
+	if (nargs > 1) {
+		sb_iters = atoi(args[1]);
+	}
+	if (nargs > 2 || sb_iters == 0) {
+		kprintf("Usage: swb [iterations]\n");
+		return EINVAL;
+	}
+
+	sb_ping = sem_create("switchbench ping", 0);
+	sb_pong = sem_create("switchbench pong", 0);
+	sb_done = sem_create("switchbench done", 0);
+	if (sb_ping == NULL || sb_pong == NULL || sb_done == NULL) {
+		panic("switchbench: out of memory\n");
+	}
+
+	switchbench_run("kernel", NULL, NULL);
+
+	p1 = switchbench_proc();
+	switchbench_run("same", p1, p1);
+	switchbench_unproc(p1);
+
+	p1 = switchbench_proc();
+	p2 = switchbench_proc();
+	switchbench_run("two", p1, p2);
+	switchbench_unproc(p1);
+	switchbench_unproc(p2);
+
+#if defined(UW) && !OPT_A2
+	/*
+	 * Destroying the last process signals no_proc_sem, as if a
+	 * menu program had finished; take that back so the next one
+	 * is still waited for. (With OPT_A2 the menu waits by pid.)
+	 */
+	P(no_proc_sem);
+	P(no_proc_sem);
+#endif
+
+	sem_destroy(sb_done);
+	sem_destroy(sb_pong);
+	sem_destroy(sb_ping);
+	return 0;
+}
@@ -50,6 +50,11 @@
 #include <addrspace.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <counter.h>
+#include <cpus.h>
+#include <boottask.h>
+#include <tlbbatch.h>
+#include <smpcall.h>
 
 #include "opt-synchprobs.h"
 
@@ -72,6 +77,19 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/*
+ * CPUs taken offline with cpus_offline, one bit each. A CPU's bit only
+ * changes with that CPU's run queue lock held, so anyone holding the
+ * lock can trust it; unlocked reads are hints. Both masks are only
+ * written with cpu_hotplug_lock held (by us or by whoever is waiting
+ * for us).
+ */
+static volatile uint32_t cpu_offmask;
+static volatile uint32_t cpu_parkmask;	/* parking thread on the way */
+static struct lock *cpu_hotplug_lock;	/* one offline/online at a time */
+
+#define CPU_ISOFFLINE(c) ((cpu_offmask & ((uint32_t)1 << (c)->c_number)) != 0)
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -331,12 +349,25 @@ thread_panic(void)
 void
 thread_shutdown(void)
 {
+	unsigned i;
+	struct cpu *c;
+
 	/*
-	 * Stop the other CPUs.
+	 * Park the other CPUs first, so anything still on their run
+	 * queues comes over here instead of being lost, then stop
+	 * them.
 	 *
 	 * We should probably wait for them to stop and shut them off
 	 * on the system board.
 	 */
+	if (cpu_hotplug_lock != NULL) {
+		for (i=0; i < cpuarray_num(&allcpus); i++) {
+			c = cpuarray_get(&allcpus, i);
+			if (c != curcpu->c_self) {
+				cpus_offline(c);
+			}
+		}
+	}
 	ipi_broadcast(IPI_OFFLINE);
 }
 
@@ -387,8 +418,9 @@ thread_bootstrap(void)
  * New CPUs come here once MD initialization is finished. curthread
  * and curcpu should already be initialized.
  *
- * Other than clearing thread_start_cpus() to continue, we don't need
- * to do anything. The startup thread can just exit; we only need it
+ * Other than clearing thread_start_cpus() to continue and helping
+ * with the rest of boot (see boottask.h), we don't need to do
+ * anything. The startup thread can then just exit; we only need it
  * to be able to get into thread_switch() properly.
  */
 void
@@ -403,6 +435,7 @@ cpu_hatch(unsigned software_number)
 	kprintf("cpu%u: %s\n", software_number, cpu_identify());
 
 	V(cpu_startup_sem);
+	boottask_help();
 	thread_exit();
 }
 
@@ -416,6 +449,11 @@ thread_start_cpus(void)
 
 	kprintf("cpu0: %s\n", cpu_identify());
 
+	cpu_hotplug_lock = lock_create("cpu hotplug");
+	if (cpu_hotplug_lock == NULL) {
+		panic("thread_start_cpus: out of memory\n");
+	}
+
 	cpu_startup_sem = sem_create("cpu_hatch", 0);
 	mainbus_start_cpus();
 	
@@ -426,6 +464,50 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+unsigned
+cpus_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpus_get(unsigned i)
+{
+	return cpuarray_get(&allcpus, i);
+}
+
+bool
+cpus_isonline(struct cpu *c)
+{
+	return !CPU_ISOFFLINE(c);
+}
+
+/*
+ * Choose an online CPU to give a thread to: the one with the
+ * shortest run queue, going by unlocked counts.
+ */
+static
+struct cpu *
+cpu_pickonline(void)
+{
+	struct cpu *c, *best;
+	unsigned i;
+
+	best = NULL;
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (CPU_ISOFFLINE(c)) {
+			continue;
+		}
+		if (best == NULL ||
+		    c->c_runqueue.tl_count < best->c_runqueue.tl_count) {
+			best = c;
+		}
+	}
+	KASSERT(best != NULL);
+	return best;
+}
+
 /*
  * Make a thread runnable.
  *
@@ -444,9 +526,17 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	if (already_have_lock) {
 		/* The target thread's cpu should be already locked. */
 		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
+		KASSERT(!CPU_ISOFFLINE(targetcpu));
 	}
 	else {
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
+		while (CPU_ISOFFLINE(targetcpu)) {
+			/* it last ran somewhere that is now switched off */
+			spinlock_release(&targetcpu->c_runqueue_lock);
+			targetcpu = cpu_pickonline();
+			target->t_cpu = targetcpu;
+			spinlock_acquire(&targetcpu->c_runqueue_lock);
+		}
 	}
 
 	isidle = targetcpu->c_isidle;
@@ -479,6 +569,21 @@ thread_fork(const char *name,
 	    struct proc *proc,
 	    void (*entrypoint)(void *data1, unsigned long data2),
 	    void *data1, unsigned long data2)
+{
+	return thread_fork_cpu(name, proc, curthread->t_cpu,
+			       entrypoint, data1, data2);
+}
+
+/*
+ * thread_fork, but start the new thread on CPU rather than the
+ * caller's.
+ */
+int
+thread_fork_cpu(const char *name,
+		struct proc *proc,
+		struct cpu *cpu,
+		void (*entrypoint)(void *data1, unsigned long data2),
+		void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
@@ -505,7 +610,7 @@ thread_fork(const char *name,
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpu = cpu;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -528,9 +633,11 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock the cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
 
+	pcpu_counter_inc(&kstat_thread_forks);
+
 	return 0;
 }
 
@@ -580,6 +687,8 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 		return;
 	}
 
+	pcpu_counter_inc(&kstat_switches);
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
@@ -709,7 +818,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc)
 	spinlock_release(&curcpu->c_runqueue_lock);
 
 	/* Activate our address space in the MMU. */
-	as_activate();
+	tlbbatch_activate();
 
 	/* Clean up dead threads. */
 	exorcise();
@@ -742,7 +851,7 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	spinlock_release(&curcpu->c_runqueue_lock);
 
 	/* Activate our address space in the MMU. */
-	as_activate();
+	tlbbatch_activate();
 
 	/* Clean up dead threads. */
 	exorcise();
@@ -856,15 +965,25 @@ void
 thread_consider_migration(void)
 {
 	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
+	unsigned i, numcpus, numonline;
 	struct cpu *c;
 	struct threadlist victims;
 	struct thread *t;
 
+	if (cpu_parkmask & ((uint32_t)1 << curcpu->c_number)) {
+		/* don't send the parking thread somewhere else */
+		return;
+	}
+
 	my_count = total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
+	numonline = 0;
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
+		if (CPU_ISOFFLINE(c)) {
+			continue;
+		}
+		numonline++;
 		spinlock_acquire(&c->c_runqueue_lock);
 		total_count += c->c_runqueue.tl_count;
 		if (c == curcpu->c_self) {
@@ -872,8 +991,9 @@ thread_consider_migration(void)
 		}
 		spinlock_release(&c->c_runqueue_lock);
 	}
+	KASSERT(numonline > 0);
 
-	one_share = DIVROUNDUP(total_count, numcpus);
+	one_share = DIVROUNDUP(total_count, numonline);
 	if (my_count < one_share) {
 		return;
 	}
@@ -893,6 +1013,10 @@ thread_consider_migration(void)
 			continue;
 		}
 		spinlock_acquire(&c->c_runqueue_lock);
+		if (CPU_ISOFFLINE(c)) {
+			spinlock_release(&c->c_runqueue_lock);
+			continue;
+		}
 		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
 			t = threadlist_remhead(&victims);
 			/*
@@ -959,6 +1083,143 @@ thread_consider_migration(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * CPU offline and online.
+ *
+ * To take a CPU offline we start a "parking" thread on it. (Until
+ * the thread gets to run, the CPU does no migration, so the thread
+ * cannot be moved to another CPU.) Once running there, the parking
+ * thread marks the CPU offline and hands
+ * everything on its run queue to the other CPUs. It then destroys
+ * the CPU's zombies and sits in cpu_idle until the CPU is brought
+ * back. While the bit is set, thread_make_runnable sends any thread
+ * that last ran on the CPU somewhere else. Migration leaves the CPU
+ * alone, and hardclock there does its timekeeping but no scheduling.
+ * So nothing but the parking thread runs there until the bit is
+ * cleared. Then the parking thread exits and the CPU picks up work
+ * again like any other.
+ */
+
+static
+void
+cpu_park(void *data1, unsigned long junk)
+{
+	struct semaphore *parked = data1;
+	struct threadlist moving;
+	struct thread *t;
+	struct cpu *c;
+	int spl;
+
+	(void)junk;
+
+	spl = splhigh();
+	c = curcpu->c_self;
+
+	threadlist_init(&moving);
+	spinlock_acquire(&c->c_runqueue_lock);
+	cpu_offmask |= (uint32_t)1 << c->c_number;
+	cpu_parkmask &= ~((uint32_t)1 << c->c_number);
+	while ((t = threadlist_remhead(&c->c_runqueue)) != NULL) {
+		threadlist_addtail(&moving, t);
+	}
+	spinlock_release(&c->c_runqueue_lock);
+
+	/* each one is redirected to an online cpu */
+	while ((t = threadlist_remhead(&moving)) != NULL) {
+		thread_make_runnable(t, false);
+	}
+	threadlist_cleanup(&moving);
+	exorcise();
+
+	V(parked);
+
+	spinlock_acquire(&c->c_runqueue_lock);
+	c->c_isidle = true;
+	spinlock_release(&c->c_runqueue_lock);
+
+	while (CPU_ISOFFLINE(c)) {
+		cpu_idle();
+	}
+
+	spinlock_acquire(&c->c_runqueue_lock);
+	c->c_isidle = false;
+	spinlock_release(&c->c_runqueue_lock);
+
+	splx(spl);
+	thread_exit();
+}
+
+/*
+ * Take C offline. Waits until C has handed off its threads. The last
+ * online CPU cannot be taken offline.
+ */
+int
+cpus_offline(struct cpu *c)
+{
+	struct semaphore *parked;
+	unsigned i, numonline;
+	int result;
+
+	lock_acquire(cpu_hotplug_lock);
+
+	if (CPU_ISOFFLINE(c)) {
+		lock_release(cpu_hotplug_lock);
+		return 0;
+	}
+	numonline = 0;
+	for (i=0; i < cpuarray_num(&allcpus); i++) {
+		if (!CPU_ISOFFLINE(cpuarray_get(&allcpus, i))) {
+			numonline++;
+		}
+	}
+	if (numonline == 1) {
+		lock_release(cpu_hotplug_lock);
+		return EBUSY;
+	}
+
+	parked = sem_create("cpu park", 0);
+	if (parked == NULL) {
+		lock_release(cpu_hotplug_lock);
+		return ENOMEM;
+	}
+	cpu_parkmask |= (uint32_t)1 << c->c_number;
+	result = thread_fork_cpu("cpu park", kproc, c, cpu_park, parked, 0);
+	if (result) {
+		cpu_parkmask &= ~((uint32_t)1 << c->c_number);
+		sem_destroy(parked);
+		lock_release(cpu_hotplug_lock);
+		return result;
+	}
+	P(parked);
+	sem_destroy(parked);
+
+	lock_release(cpu_hotplug_lock);
+	return 0;
+}
+
+/*
+ * Bring C back online.
+ */
+int
+cpus_online(struct cpu *c)
+{
+	lock_acquire(cpu_hotplug_lock);
+
+	if (CPU_ISOFFLINE(c)) {
+		spinlock_acquire(&c->c_runqueue_lock);
+		cpu_offmask &= ~((uint32_t)1 << c->c_number);
+		spinlock_release(&c->c_runqueue_lock);
+
+		/* get it out of cpu_idle */
+		ipi_send(c, IPI_UNIDLE);
+	}
+
+	lock_release(cpu_hotplug_lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Wait channel functions
  */
@@ -1113,16 +1374,39 @@ wchan_isempty(struct wchan *wc)
  */
 
 /*
- * Send an IPI (inter-processor interrupt) to the specified CPU.
+ * Post IPI CODE to TARGET, whose c_ipi_lock the caller holds. If
+ * anything is already pending there, an interrupt is already on its
+ * way and its handler has not yet taken the pending bits (it does
+ * that under the same lock), so it will see this one too; don't send
+ * another.
  */
 void
-ipi_send(struct cpu *target, int code)
+ipi_post(struct cpu *target, int code)
 {
+	bool idle;
+
 	KASSERT(code >= 0 && code < 32);
+	KASSERT(spinlock_do_i_hold(&target->c_ipi_lock));
 
-	spinlock_acquire(&target->c_ipi_lock);
+	idle = (target->c_ipi_pending == 0);
 	target->c_ipi_pending |= (uint32_t)1 << code;
-	mainbus_send_ipi(target);
+	if (idle) {
+		mainbus_send_ipi(target);
+		pcpu_counter_inc(&kstat_ipis);
+	}
+	else {
+		pcpu_counter_inc(&kstat_ipis_coalesced);
+	}
+}
+
+/*
+ * Send an IPI (inter-processor interrupt) to the specified CPU.
+ */
+void
+ipi_send(struct cpu *target, int code)
+{
+	spinlock_acquire(&target->c_ipi_lock);
+	ipi_post(target, code);
 	spinlock_release(&target->c_ipi_lock);
 }
 
@@ -1156,8 +1440,7 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 		target->c_numshootdown = n+1;
 	}
 
-	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
-	mainbus_send_ipi(target);
+	ipi_post(target, IPI_TLBSHOOTDOWN);
 
 	spinlock_release(&target->c_ipi_lock);
 }
@@ -1165,6 +1448,7 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 void
 interprocessor_interrupt(void)
 {
+	struct smpcall *calls;
 	uint32_t bits;
 	int i;
 
@@ -1203,7 +1487,16 @@ interprocessor_interrupt(void)
 		}
 		curcpu->c_numshootdown = 0;
 	}
+	calls = NULL;
+	if (bits & (1U << IPI_CALL)) {
+		calls = smpcall_take();
+	}
 
 	curcpu->c_ipi_pending = 0;
 	spinlock_release(&curcpu->c_ipi_lock);
+
+	/* not under c_ipi_lock, as the calls may send IPIs themselves */
+	if (calls != NULL) {
+		smpcall_run(calls);
+	}
 }
@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
@@ -56,3 +57,77 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+#if OPT_A2
+#ifndef CLOCK_REALTIME
+#define CLOCK_REALTIME	0
+#define CLOCK_MONOTONIC	1
+#endif
+
+/*
+ * struct timespec as user programs see it.
+ */
+struct utimespec {
+	time_t tv_sec;
+	uint32_t tv_nsec;
+};
+
+/*
+ * clock_gettime: CLOCK_REALTIME is the time of day, as from __time;
+ * CLOCK_MONOTONIC counts from boot and never goes backwards. Unlike
+ * __time, both halves go out in one copyout.
+ */
+int
+sys_clock_gettime(int clockid, userptr_t user_ts)
+{
+	struct utimespec ts;
+	uint64_t ns;
+
+	switch (clockid) {
+	    case CLOCK_REALTIME:
+		gettime(&ts.tv_sec, &ts.tv_nsec);
+		break;
+	    case CLOCK_MONOTONIC:
+		ns = clock_monotonic_ns();
+		ts.tv_sec = ns / 1000000000;
+		ts.tv_nsec = ns % 1000000000;
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	return copyout(&ts, user_ts, sizeof(ts));
+}
+
+/*
+ * nanosleep: sleep for the interval in USER_REQ. There are no signals
+ * to cut a sleep short, so the remaining time, if asked for, is
+ * always zero.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct utimespec ts;
+	int result;
+
+	result = copyin(user_req, &ts, sizeof(ts));
+	if (result) {
+		return result;
+	}
+	if (ts.tv_sec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	result = clock_sleepns((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+	if (result) {
+		return result;
+	}
+
+	if (user_rem != NULL) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+		result = copyout(&ts, user_rem, sizeof(ts));
+	}
+	return result;
+}
+#endif /* OPT_A2 */
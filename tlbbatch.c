@@ -0,0 +1,85 @@
+/*
+ * Address-space-aware TLB activation. See tlbbatch.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <counter.h>
+#include <cpus.h>
+#include <tlbbatch.h>
+
+/*
+ * What each CPU's TLB holds. An entry is protected by its CPU's
+ * c_ipi_lock.
+ */
+static struct tlbcpu {
+	struct addrspace *tc_as;	/* address space the TLB is loaded for */
+} __attribute__((aligned(PCPU_CACHELINE))) tlbcpus[PCPU_MAXCPUS];
+
+/*
+ * Note which address space this CPU is about to run and activate it
+ * if need be.
+ *
+ * as_activate throws away the whole TLB, so it is only worth calling
+ * when the CPU last loaded some other address space. Switching
+ * between threads of the same process, or out to a kernel thread and
+ * back, keeps the TLB as it is. Kernel threads have no address
+ * space and never touch user mappings, so they leave the loaded one
+ * alone.
+ */
+void
+tlbbatch_activate(void)
+{
+	struct addrspace *as;
+	struct tlbcpu *tc;
+	bool load;
+
+	as = curproc_getas();
+	if (as == NULL) {
+		return;
+	}
+
+	KASSERT(curcpu->c_number < PCPU_MAXCPUS);
+	tc = &tlbcpus[curcpu->c_number];
+
+	spinlock_acquire(&curcpu->c_ipi_lock);
+	load = (tc->tc_as != as);
+	tc->tc_as = as;
+	spinlock_release(&curcpu->c_ipi_lock);
+
+	if (load) {
+		as_activate();
+		pcpu_counter_inc(&kstat_as_activates);
+	}
+}
+
+/*
+ * AS is going away. It may still be loaded, and a new address space
+ * could be allocated at the same address and then be taken for it
+ * and not activated; mark those CPUs as having nothing loaded. The
+ * only thread that can still be using it is the one discarding it
+ * (in exit or exec), which is past its last user-mode instruction.
+ */
+void
+tlbbatch_forget(struct addrspace *as)
+{
+	struct tlbcpu *tc;
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i < cpus_count(); i++) {
+		c = cpus_get(i);
+		tc = &tlbcpus[c->c_number];
+
+		spinlock_acquire(&c->c_ipi_lock);
+		if (tc->tc_as == as) {
+			tc->tc_as = NULL;
+		}
+		spinlock_release(&c->c_ipi_lock);
+	}
+}
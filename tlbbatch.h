@@ -0,0 +1,36 @@
+#ifndef _TLBBATCH_H_
+#define _TLBBATCH_H_
+
+/*
+ * Address-space-aware TLB activation.
+ *
+ * Each CPU records which address space its TLB was last loaded for
+ * (every thread switch goes through tlbbatch_activate). as_activate
+ * throws away the whole TLB, so it is only called when what the TLB
+ * holds belongs to some other address space.
+ *
+ * Shootdowns still go through ipi_tlbshootdown, which reaches every
+ * CPU whatever it has loaded, so a TLB kept across a switch never
+ * misses an invalidation.
+ *
+ * Functions:
+ *     tlbbatch_activate  - call on every thread switch instead of
+ *                          as_activate; tracks what each CPU has
+ *                          loaded and calls as_activate only if that
+ *                          has to change.
+ *     tlbbatch_forget    - call before destroying an address space
+ *                          that may have been activated, so a new one
+ *                          at the same address is not mistaken for it.
+ *
+ * Since tlbbatch_activate skips as_activate when the address space
+ * is already loaded, switching between threads of one process, or
+ * into a kernel thread and back, costs no TLB flush and no refill
+ * faults afterwards.
+ */
+
+struct addrspace;
+
+void tlbbatch_activate(void);
+void tlbbatch_forget(struct addrspace *as);
+
+#endif /* _TLBBATCH_H_ */
@@ -0,0 +1,133 @@
+/*
+ * tlbbench.c
+ *
+ * User-level TLB shootdown benchmark. Not part of the kernel: build
+ * it as a testbin program.
+ *
+ * Usage: tlbbench [nworkers [heap_kb [iterations]]]
+ *
+ * Starts NWORKERS (default 4) processes, so that the CPUs are busy
+ * running several different address spaces. Each worker dirties
+ * HEAP_KB (default 256) of heap and then, ITERATIONS times, forks a
+ * child that writes every page of its copy of the heap and exits,
+ * while the worker itself writes every page too. Every child exit
+ * throws away a whole address space, and the workers keep switching
+ * between address spaces, so this exercises TLB reloads on switch
+ * and the teardown path on exit.
+ *
+ * The time reported is the measured wall time for the whole run;
+ * ns_per_exit divides it by the number of child fork/exit cycles.
+ *
+ * A user program cannot see how often the TLB was reloaded, so reset
+ * the kernel statistics with "ks reset" before running this and print
+ * them with "ks" afterwards: as_activates is the number of thread
+ * switches that had to load a different address space.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#define DEFAULT_WORKERS	4
+#define DEFAULT_HEAP_KB	256
+#define DEFAULT_ITERS	20
+#define PAGESIZE	4096
+
+static char *heap;
+static size_t heapsize;
+
+static
+void
+touch(void)
+{
+	size_t i;
+
+	for (i=0; i<heapsize; i+=PAGESIZE) {
+		heap[i]++;
+	}
+}
+
+static
+void
+worker(int iters)
+{
+	pid_t pid;
+	int i, status;
+
+	touch();
+	for (i=0; i<iters; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			touch();
+			_exit(0);
+		}
+		touch();
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+	}
+	_exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int nworkers = DEFAULT_WORKERS;
+	int iters = DEFAULT_ITERS;
+	unsigned long long ns, exits;
+	time_t s1, s2;
+	unsigned long ns1, ns2;
+	pid_t pid;
+	int i, status;
+
+	heapsize = DEFAULT_HEAP_KB * 1024;
+	if (argc > 1) {
+		nworkers = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		heapsize = atoi(argv[2]) * 1024;
+	}
+	if (argc > 3) {
+		iters = atoi(argv[3]);
+	}
+	if (argc > 4 || nworkers <= 0 || heapsize == 0 || iters <= 0) {
+		errx(1, "Usage: tlbbench [nworkers [heap_kb [iterations]]]");
+	}
+
+	heap = malloc(heapsize);
+	if (heap == NULL) {
+		errx(1, "malloc of %lu bytes failed", (unsigned long)heapsize);
+	}
+
+	__time(&s1, &ns1);
+	for (i=0; i<nworkers; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			worker(iters);
+		}
+	}
+	for (i=0; i<nworkers; i++) {
+		if (waitpid(-1, &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+	}
+	__time(&s2, &ns2);
+
+	ns = (unsigned long long)(s2 - s1) * 1000000000ULL + ns2 - ns1;
+	exits = (unsigned long long)nworkers * iters;
+	printf("tlbbench workers=%d heap_kb=%lu iters=%d exits=%llu "
+	       "time_ns=%llu ns_per_exit=%llu\n",
+	       nworkers, (unsigned long)(heapsize / 1024), iters,
+	       exits, ns, ns / exits);
+	return 0;
+}
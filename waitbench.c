@@ -0,0 +1,130 @@
+/*
+ * waitbench.c
+ *
+ * User-level benchmark for reaping children with waitpid(-1).
+ * Not part of the kernel: build it as a testbin program.
+ *
+ * Usage: waitbench [nchildren]
+ *
+ * Forks NCHILDREN children (default 500) that exit at once, then
+ * reaps them three ways and prints the reaping rate for each:
+ *
+ *   inorder - waitpid(pid[i]) for each child in fork order, the only
+ *             option before WNOHANG and pid -1;
+ *   any     - waitpid(-1) until ECHILD, taking whichever child has
+ *             exited first;
+ *   poll    - waitpid(-1, WNOHANG) in a loop, as a supervisor that
+ *             has other work to do would.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <err.h>
+
+#define DEFAULT_CHILDREN	500
+#define MAXCHILDREN		4096
+
+static pid_t pids[MAXCHILDREN];
+
+static
+void
+spawn(int n)
+{
+	int i;
+
+	for (i=0; i<n; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			_exit(0);
+		}
+	}
+}
+
+static
+void
+report(const char *how, int n, time_t s1, unsigned long ns1,
+       unsigned long polls)
+{
+	time_t s2;
+	unsigned long ns2;
+	unsigned long long ns;
+
+	__time(&s2, &ns2);
+	ns = (unsigned long long)(s2 - s1) * 1000000000ULL + ns2 - ns1;
+	printf("waitbench %s children=%d time_ns=%llu reaps_per_sec=%llu "
+	       "empty_polls=%lu\n", how, n, ns,
+	       ns > 0 ? (unsigned long long)n * 1000000000ULL / ns : 0,
+	       polls);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int n = DEFAULT_CHILDREN;
+	unsigned long polls;
+	time_t s1;
+	unsigned long ns1;
+	pid_t pid;
+	int i, status;
+
+	if (argc > 1) {
+		n = atoi(argv[1]);
+	}
+	if (argc > 2 || n <= 0 || n > MAXCHILDREN) {
+		errx(1, "Usage: waitbench [nchildren (1-%d)]", MAXCHILDREN);
+	}
+
+	/* one specific child at a time */
+	spawn(n);
+	__time(&s1, &ns1);
+	for (i=0; i<n; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+	}
+	report("inorder", n, s1, ns1, 0);
+
+	/* any child, blocking */
+	spawn(n);
+	__time(&s1, &ns1);
+	for (i=0; ; i++) {
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno != ECHILD) {
+				err(1, "waitpid");
+			}
+			break;
+		}
+	}
+	if (i != n) {
+		errx(1, "reaped %d children, expected %d", i, n);
+	}
+	report("any", n, s1, ns1, 0);
+
+	/* any child, polling */
+	spawn(n);
+	__time(&s1, &ns1);
+	polls = 0;
+	for (i=0; i<n; ) {
+		pid = waitpid(-1, &status, WNOHANG);
+		if (pid < 0) {
+			err(1, "waitpid");
+		}
+		if (pid == 0) {
+			polls++;
+			continue;
+		}
+		i++;
+	}
+	report("poll", n, s1, ns1, polls);
+
+	return 0;
+}